@@ -11,6 +11,8 @@
 #include "../solver/rule.h"
 #include "../solver/rules.h"
 #include "../solver/solver.h"
+#include "../solver/solverengine.h"
+#include "../solver/solvesession.h"
 
 
 /* Generator constructor */
@@ -22,6 +24,10 @@ Generator::Generator(int m, int n, Difficulty difficulty) {
 
     buffer_ = 0;
 
+    /* settle whether a puzzle has a single solution by counting its
+     * solutions rather than by guessing without a depth limit */
+    solverOptions_.engine = HYBRID_ENGINE;
+
     srand(time(NULL));
     setDifficulty(difficulty);
     createPuzzle();
@@ -68,6 +74,10 @@ void Generator::createPuzzle() {
     Import importer = Import(grid_, m_, n_);
     LoopGen loopgen = LoopGen(m_, n_, grid_);
 
+    /* build the rules once for every attempt at removing a number */
+    engine_.reset(new SolverEngine(grid_, selectedRules_, numberOfRules_, guessDepth_, solverOptions_));
+    session_.reset(new SolveSession(*engine_));
+
     initArrays();
     setCounts();
     grid_.copy(smallestCountGrid_);
@@ -258,18 +268,9 @@ void Generator::fillEligibleVector() {
 }
 
 bool Generator::checkIfSolved() {
-    Rule rules_[NUM_RULES];
-    initRules(rules_);
-    Contradiction contradictions_[NUM_CONTRADICTIONS];
-    initContradictions(contradictions_);
     grid_.resetGrid();
 
-    Solver solver = Solver(grid_, rules_, contradictions_, selectedRules_, numberOfRules_, guessDepth_);
-    if (grid_.isSolved()) {
-        return true;
-    } else {
-        return false;
-    }
+    return session_->solve(grid_).status == SOLVED_STATUS;
 }
 
 /* Pops Coordinates out of ineligible vector, marking
@@ -365,8 +366,7 @@ void Generator::deleteNumbers() {
 
         // TODO: maybe modify selected rules
 
-        Solver solver = Solver(grid_, rules_, contradictions_, selectedRules_, NUM_RULES - NUM_CONST_RULES, 1);
-        if (!grid_.isSolved()) {
+        if (session_->solve(grid_).status != SOLVED_STATUS) {
             grid_.setNumber(i, j, oldNum);
         } else {
             minusCounts(oldNum);
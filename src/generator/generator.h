@@ -5,8 +5,11 @@
 #include "../solver/contradiction.h"
 #include "../solver/rule.h"
 #include "../solver/solver.h"
+#include "../solver/solverengine.h"
+#include "../solver/solvesession.h"
 
 
+#include <memory>
 #include <stack>
 
 class Generator {
@@ -64,13 +67,14 @@ class Generator {
         int threeCount_;
         int * selectedRules_;
         int numberOfRules_;
+        SolverOptions solverOptions_;
         Grid grid_;
         Grid smallestCountGrid_;
         std::vector <Coordinates> eligibleCoordinates_;
 
         std::vector <Coordinates> ineligibleCoordinates_;
-        Rule * rules_;
-        Contradiction * contradictions_;
+        std::unique_ptr<SolverEngine> engine_;
+        std::unique_ptr<SolveSession> session_;
         bool ** canEliminate_;
         Number ** oldNumbers_;
 };
@@ -11,6 +11,8 @@
 #define NUM_CONST_RULES 3
 #define NUM_CONTRADICTIONS 11
 
+#define NO_CAUSE -1     /* an edge set by a guess or by anything but a rule or a nogood */
+
 #define EASY_RULES { 4, 1, 3, 2, 20, 23, 0, 10, 9, 19, 11, 26 }
 #define HARD_RULES { 4, 1, 3, 2, 20, 23, 0, 10, 9, 19, 11, 26, 8, 16, 7, 6, 27, 13, 5, 12, 18 }
 
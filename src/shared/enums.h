@@ -1,11 +1,19 @@
 #ifndef ENUMS_H
 #define ENUMS_H
 
-enum Edge { EMPTY, LINE, NLINE };
-enum Number { NONE, ZERO, ONE, TWO, THREE };
+enum Edge : unsigned char { EMPTY, LINE, NLINE };
+enum Number : unsigned char { NONE, ZERO, ONE, TWO, THREE };
 enum Orientation { UP, DOWN, LEFT, RIGHT, UPFLIP, DOWNFLIP, LEFTFLIP, RIGHTFLIP };
-enum LoopCell { UNKNOWN, EXP, NOEXP, OUT };
+enum LoopCell : unsigned char { UNKNOWN, EXP, NOEXP, OUT };
 
 enum Difficulty { EASY, HARD };
 
+enum Engine { RULE_ENGINE, SAT_ENGINE, HYBRID_ENGINE };
+
+enum SolveStatus { SOLVED_STATUS, UNSOLVED_STATUS, INVALID_STATUS, MULTIPLE_STATUS };
+
+enum Ordering { FLAT_ORDERING, NEIGHBOR_ORDERING, CONTOUR_ORDERING, CLUE_ORDERING, ADAPTIVE_ORDERING, NUM_ORDERINGS };
+
+enum ChangeQueue { RULE_QUEUE, CONTRADICTION_QUEUE, PROBE_QUEUE, CLAUSE_QUEUE, COLOR_QUEUE, CONNECTIVITY_QUEUE, NUM_QUEUES };
+
 #endif
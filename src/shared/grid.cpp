@@ -1,123 +1,109 @@
- #include "grid.h"
+#include "grid.h"
+#include <algorithm>
 #include <cassert>
+#include <climits>
+#include <cstring>
+#include <stdint.h>
 #include <vector>
 #include "contour.h"
 #include "enums.h"
 
-Grid::~Grid() {
-    if (init_) {
-        for (int i = 0; i < m_; i++) {
-            delete [] updateMatrix_[i];
-        }
-        delete [] updateMatrix_;
-
-        for (int i = 0; i < m_; i++) {
-            delete [] contraMatrix_[i];
-        }
-        delete [] contraMatrix_;
-
-        for (int i = 0; i < m_+1; i++) {
-            delete [] contourMatrix_[i];
-        }
-        delete [] contourMatrix_;
-    }
-}
-
 void Grid::resetGrid() {
+    assert(checkpoints_.empty());
+
     for (int i = 1; i < getHeight(); i++) {
         for (int j = 1; j < getWidth()-1; j++) {
-            hlines_[i][j] = EMPTY;
+            hlines_[i*stride_ + j] = EMPTY;
         }
     }
 
     for (int i = 1; i < getHeight()-1; i++) {
         for (int j = 1; j < getWidth(); j++) {
-            vlines_[i][j] = EMPTY;
-        }
-    }
-
-    for (int i = 0; i < getHeight(); i++) {
-        for (int j = 0; j < getWidth(); j++) {
-            setUpdateMatrix(i, j, true);
-            setContraMatrix(i, j, true);
+            vlines_[i*stride_ + j] = EMPTY;
         }
     }
 
-    for (int i = 0; i < getHeight()+1; i++) {
-        for (int j = 0; j < getWidth()+1; j++) {
-            setContourMatrix(i, j, std::make_pair(-1,-1));
-        }
-    }
+    memset(contourMatrix_, -1, (m_+1) * stride_ * sizeof(int));
+    std::fill(causes_, causes_ + getEdgeCount(), NO_CAUSE);
+    resetColors();
 
     numClosedLoops_ = 0;
     numOpenLoops_ = 0;
+    fewestLoopsChecked_ = INT_MAX;
+    valid_ = true;
+    pendingClosure_ = -1;
+    cause_ = NO_CAUSE;
+
+    recountClues();
+    recountVertices();
+    rehash();
+    clearChanges();
 }
 
 /*
- * Copies grid for the purpose of making a guess.
+ * Copies grid for the purpose of making a guess. Every plane of
+ * the grid lives in one block, so this is a single memcpy once
+ * newGrid has a block of the same dimensions, along with the edges
+ * still waiting on some queue. The edges every queue has already
+ * seen are left behind, so the copy of the queue stays as short as
+ * what is pending rather than growing with the log of the grid.
  */
 void Grid::copy(Grid & newGrid) const {
-    newGrid.initArrays(getHeight(), getWidth());
-    newGrid.initUpdateMatrix();
-
-    for (int i = 0; i < getHeight()+1; i++) {
-        for (int j = 0; j < getWidth(); j++) {
-            newGrid.changeHLine(i, j, getHLine(i,j));
-        }
-    }
-
-    for (int i = 0; i < getHeight(); i++) {
-        for (int j = 0; j < getWidth()+1; j++) {
-            newGrid.changeVLine(i, j, getVLine(i,j));
-        }
-    }
+    assert(newGrid.checkpoints_.empty());
 
-    for (int i = 0; i < getHeight(); i++) {
-        for (int j = 0; j < getWidth(); j++) {
-            newGrid.setNumber(i, j, getNumber(i,j));
-            newGrid.setUpdateMatrix(i, j, updateMatrix_[i][j]);
-            newGrid.setContraMatrix(i, j, contraMatrix_[i][j]);
-        }
+    if (!newGrid.init_ || newGrid.m_ != m_ || newGrid.n_ != n_) {
+        newGrid.initArrays(getHeight(), getWidth());
+        newGrid.initUpdateMatrix();
     }
 
-    for (int i = 0; i < getHeight()+1; i++) {
-        for (int j = 0; j < getWidth()+1; j++) {
-            newGrid.setContourMatrix(i, j, contourMatrix_[i][j]);
-        }
-    }
+    memcpy(newGrid.block_, block_, blockBytes_);
 
+    newGrid.valid_ = valid_;
+    newGrid.updated_ = updated_;
     newGrid.numOpenLoops_ = numOpenLoops_;
     newGrid.numClosedLoops_ = numClosedLoops_;
-}
+    newGrid.fewestLoopsChecked_ = fewestLoopsChecked_;
+    newGrid.unsatisfiedClues_ = unsatisfiedClues_;
+    newGrid.violatedClues_ = violatedClues_;
+    newGrid.pendingClosure_ = pendingClosure_;
+    newGrid.hash_ = hash_;
 
+    int seen = changes_.size();
+    for (int q = 0; q < NUM_QUEUES; q++) {
+        seen = std::min(seen, changesHead_[q]);
+    }
+    newGrid.changes_.assign(changes_.begin() + seen, changes_.end());
+    for (int q = 0; q < NUM_QUEUES; q++) {
+        newGrid.changesHead_[q] = changesHead_[q] - seen;
+        newGrid.fullSweep_[q] = fullSweep_[q];
+    }
+}
 
+/*
+ * Copies the contents of the grid into a grid of the same
+ * dimensions without touching its loop counts.
+ */
 void Grid::clearAndCopy(Grid & newGrid) {
-    for (int i = 0; i < getHeight()+1; i++) {
-        for (int j = 0; j < getWidth(); j++) {
-            newGrid.changeHLine(i, j, getHLine(i,j));
-        }
-    }
+    assert(newGrid.m_ == m_ && newGrid.n_ == n_);
+    assert(newGrid.checkpoints_.empty());
 
-    for (int i = 0; i < getHeight(); i++) {
-        for (int j = 0; j < getWidth()+1; j++) {
-            newGrid.changeVLine(i, j, getVLine(i,j));
-        }
-    }
+    memcpy(newGrid.block_, block_, blockBytes_);
 
-    for (int i = 0; i < getHeight(); i++) {
-        for (int j = 0; j < getWidth(); j++) {
-            newGrid.setNumber(i, j, getNumber(i,j));
-            newGrid.setUpdateMatrix(i, j, updateMatrix_[i][j]);
-            newGrid.setContraMatrix(i, j, contraMatrix_[i][j]);
-        }
-    }
+    newGrid.unsatisfiedClues_ = unsatisfiedClues_;
+    newGrid.violatedClues_ = violatedClues_;
+    newGrid.hash_ = hash_;
+}
 
-    for (int i = 0; i < getHeight()+1; i++) {
-        for (int j = 0; j < getWidth()+1; j++) {
-            newGrid.setContourMatrix(i, j, contourMatrix_[i][j]);
-        }
-    }
+/*
+ * Set the number at a given cell, keeping the counts of
+ * unsatisfied and violated clues up to date.
+ */
+void Grid::setNumber(int i, int j, Number num) {
+    assert(0 <= i && i < m_ && 0 <= j && j < n_);
 
+    countClue(i*stride_ + j, -1);
+    Lattice::setNumber(i, j, num);
+    countClue(i*stride_ + j, 1);
 }
 
 /*;
@@ -134,7 +120,11 @@ bool Grid::setHLine(int i, int j, Edge edge) {
 
     Edge prevEdge = getHLine(i, j);
     if (prevEdge == EMPTY) {
-        hlines_[i][j] = edge;
+        record((unsigned char *)&hlines_[i*stride_ + j]);
+        hlines_[i*stride_ + j] = edge;
+        hashEdge(&hlines_[i*stride_ + j], EMPTY, edge);
+        logChange(&hlines_[i*stride_ + j]);
+        causes_[getEdgeIndex(i, j, true)] = cause_;
     } else if (prevEdge != edge) {
         return false;
     } else if (prevEdge == edge) {
@@ -142,22 +132,27 @@ bool Grid::setHLine(int i, int j, Edge edge) {
     }
 
     // Update contour information
+    int end = -1;
     if (edge == LINE) {
-        updateContourMatrix(i, j, true);
+        end = updateContourMatrix(i, j, true);
     }
 
-    // Update which parts of grid have possible rules that could be applied
-    for (int x = std::max(0, i-3); x < std::min(i+1, getHeight()); x++) {
-        for (int y = std::max(0, j-2); y < std::min(j+1, getWidth()); y++) {
-            updateMatrix_[x][y] = true;
-        }
-    }
+    // Update the line counts of the cells on either side
+    countEdge(i-1, j, edge, 1);
+    countEdge(i, j, edge, 1);
 
-    // Update which parts of grid have possible contradictions
-    for (int x = std::max(0, i-2); x < std::min(i+1, getHeight()); x++) {
-        for (int y = std::max(0, j-1); y < std::min(j+1, getWidth()); y++) {
-            contraMatrix_[x][y] = true;
-        }
+    // Update the degrees of the points at either end, failing
+    // the grid as soon as either of them cannot be on a loop
+    countVertex(i*stride_ + j, EMPTY, -1);
+    countVertex(i*stride_ + j+1, EMPTY, -1);
+    countVertex(i*stride_ + j, edge, 1);
+    countVertex(i*stride_ + j+1, edge, 1);
+    checkVertex(i*stride_ + j);
+    checkVertex(i*stride_ + j+1);
+
+    // Rule out the edges that would close a loop too early
+    if (edge == LINE) {
+        preventEarlyClosures(end);
     }
 
     return true;
@@ -171,9 +166,17 @@ bool Grid::setHLine(int i, int j, Edge edge) {
 bool Grid::setVLine(int i, int j, Edge edge) {
     assert(0 <= i && i < m_ && 0 <= j && j < n_+1);
 
+    if (edge == EMPTY) {
+        return true;
+    }
+
     Edge prevEdge = getVLine(i, j);
     if (prevEdge == EMPTY) {
-        vlines_[i][j] = edge;
+        record((unsigned char *)&vlines_[i*stride_ + j]);
+        vlines_[i*stride_ + j] = edge;
+        hashEdge(&vlines_[i*stride_ + j], EMPTY, edge);
+        logChange(&vlines_[i*stride_ + j]);
+        causes_[getEdgeIndex(i, j, false)] = cause_;
     } else if (prevEdge != edge) {
         return false;
     } else if (prevEdge == edge) {
@@ -181,22 +184,27 @@ bool Grid::setVLine(int i, int j, Edge edge) {
     }
 
     // Update contour information
+    int end = -1;
     if (edge == LINE) {
-        updateContourMatrix(i, j, false);
+        end = updateContourMatrix(i, j, false);
     }
 
-    // Update which parts of grid have possible rules that could be applied
-    for (int x = std::max(0, i-2); x < std::min(i+1, getHeight()); x++) {
-        for (int y = std::max(0, j-3); y < std::min(j+1, getWidth()); y++) {
-            updateMatrix_[x][y] = true;
-        }
-    }
+    // Update the line counts of the cells on either side
+    countEdge(i, j-1, edge, 1);
+    countEdge(i, j, edge, 1);
 
-    // Update which parts of grid have possible contradictions
-    for (int x = std::max(0, i-1); x < std::min(i+1, getHeight()); x++) {
-        for (int y = std::max(0, j-2); y < std::min(j+1, getWidth()); y++) {
-            contraMatrix_[x][y] = true;
-        }
+    // Update the degrees of the points at either end, failing
+    // the grid as soon as either of them cannot be on a loop
+    countVertex(i*stride_ + j, EMPTY, -1);
+    countVertex((i+1)*stride_ + j, EMPTY, -1);
+    countVertex(i*stride_ + j, edge, 1);
+    countVertex((i+1)*stride_ + j, edge, 1);
+    checkVertex(i*stride_ + j);
+    checkVertex((i+1)*stride_ + j);
+
+    // Rule out the edges that would close a loop too early
+    if (edge == LINE) {
+        preventEarlyClosures(end);
     }
 
     return true;
@@ -209,8 +217,21 @@ bool Grid::setVLine(int i, int j, Edge edge) {
 bool Grid::changeHLine(int i, int j, Edge edge) {
     assert(0 <= i && i < m_+1 && 0 <= j && j < n_);
 
-    hlines_[i][j] = edge;
+    Edge prevEdge = hlines_[i*stride_ + j];
+    countEdge(i-1, j, prevEdge, -1);
+    countEdge(i, j, prevEdge, -1);
+    countVertex(i*stride_ + j, prevEdge, -1);
+    countVertex(i*stride_ + j+1, prevEdge, -1);
+
+    record((unsigned char *)&hlines_[i*stride_ + j]);
+    hlines_[i*stride_ + j] = edge;
+    hashEdge(&hlines_[i*stride_ + j], prevEdge, edge);
+    causes_[getEdgeIndex(i, j, true)] = NO_CAUSE;
 
+    countEdge(i-1, j, edge, 1);
+    countEdge(i, j, edge, 1);
+    countVertex(i*stride_ + j, edge, 1);
+    countVertex(i*stride_ + j+1, edge, 1);
 
     return true;
 }
@@ -222,7 +243,21 @@ bool Grid::changeHLine(int i, int j, Edge edge) {
 bool Grid::changeVLine(int i, int j, Edge edge) {
     assert(0 <= i && i < m_ && 0 <= j && j < n_+1);
 
-    vlines_[i][j] = edge;
+    Edge prevEdge = vlines_[i*stride_ + j];
+    countEdge(i, j-1, prevEdge, -1);
+    countEdge(i, j, prevEdge, -1);
+    countVertex(i*stride_ + j, prevEdge, -1);
+    countVertex((i+1)*stride_ + j, prevEdge, -1);
+
+    record((unsigned char *)&vlines_[i*stride_ + j]);
+    vlines_[i*stride_ + j] = edge;
+    hashEdge(&vlines_[i*stride_ + j], prevEdge, edge);
+    causes_[getEdgeIndex(i, j, false)] = NO_CAUSE;
+
+    countEdge(i, j-1, edge, 1);
+    countEdge(i, j, edge, 1);
+    countVertex(i*stride_ + j, edge, 1);
+    countVertex((i+1)*stride_ + j, edge, 1);
 
     return true;
 }
@@ -234,143 +269,638 @@ bool Grid::changeVLine(int i, int j, Edge edge) {
 bool Grid::numberSatisfied(int i, int j) const {
     assert(0 <= i && i < m_ && 0 <= j && j < n_);
 
-    Number number = numbers_[i][j];
+    Number number = getNumber(i, j);
+    return number == NONE || getLineCount(i, j) == number - ZERO;
+}
+
+/*
+ * Checks if there are any closed contours with the intention of detecting
+ * prematurely closed contours
+ */
+bool Grid::containsClosedContours() const {
+    return (numClosedLoops_>0);
+}
+
+/*
+ * Reserves room in the lattice block for the contour, line count,
+ * degree, cause and cell color planes so that the whole grid is one
+ * allocation.
+ */
+size_t Grid::extraBytes() const {
+    return alignPlane((m_+1) * stride_ * sizeof(int))
+         + 2 * alignPlane(m_ * stride_)
+         + 2 * alignPlane((m_+1) * stride_)
+         + alignPlane(2 * (m_+1) * stride_ * sizeof(int))
+         + 3 * alignPlane((m_*n_ + 1) * sizeof(int));
+}
+
+/*
+ * Points the contour, line count, degree, cause and cell color planes
+ * at their place in the block and sets them and the change queues to
+ * their initial values.
+ */
+void Grid::initUpdateMatrix() {
+    assert(init_);
+
+    unsigned char * extra = block_ + latticeBytes_;
+    contourMatrix_ = (int *)extra;
+    extra += alignPlane((m_+1) * stride_ * sizeof(int));
+    lineCounts_ = extra;
+    extra += alignPlane(m_ * stride_);
+    nlineCounts_ = extra;
+    extra += alignPlane(m_ * stride_);
+    vertexLines_ = extra;
+    extra += alignPlane((m_+1) * stride_);
+    vertexEmpties_ = extra;
+    extra += alignPlane((m_+1) * stride_);
+    causes_ = (int *)extra;
+    extra += alignPlane(2 * (m_+1) * stride_ * sizeof(int));
+    colorLinks_ = (int *)extra;
+    extra += alignPlane((m_*n_ + 1) * sizeof(int));
+    colorNext_ = (int *)extra;
+    extra += alignPlane((m_*n_ + 1) * sizeof(int));
+    colorSizes_ = (int *)extra;
+
+    memset(contourMatrix_, -1, (m_+1) * stride_ * sizeof(int));
+    std::fill(causes_, causes_ + getEdgeCount(), NO_CAUSE);
+    resetColors();
 
-    /* determine number of lines around number */
-    int numLines = (hlines_[i][j] == LINE)
-                 + (hlines_[i+1][j] == LINE)
-                 + (vlines_[i][j] == LINE)
-                 + (vlines_[i][j+1] == LINE);
+    numOpenLoops_ = 0;
+    numClosedLoops_ = 0;
+    fewestLoopsChecked_ = INT_MAX;
+    valid_ = true;
+    pendingClosure_ = -1;
+    cause_ = NO_CAUSE;
+
+    recountClues();
+    recountVertices();
+    rehash();
+    clearChanges();
+}
 
-    switch (number) {
-        case NONE:
-            return true;
-        case ZERO:
-            return numLines == 0;
-        case ONE:
-            return numLines == 1;
-        case TWO:
-            return numLines == 2;
-        case THREE:
-            return numLines == 3;
+/*
+ * Adds (sign 1) or removes (sign -1) the clue at a given offset in the
+ * number plane from the counts of unsatisfied and violated clues. A
+ * clue is violated once it has more lines than its number, or fewer
+ * edges that are not NLINE than its number.
+ */
+void Grid::countClue(int k, int sign) {
+    Number number = numbers_[k];
+    if (number == NONE) {
+        return;
     }
+
+    int value = number - ZERO;
+    unsatisfiedClues_ += sign * (lineCounts_[k] != value);
+    violatedClues_ += sign * (lineCounts_[k] > value || 4 - nlineCounts_[k] < value);
 }
 
 /*
- * Checks if the puzzle is solved by assuring that there is only one contour
- * and that each number has been satisfied
+ * Adds (sign 1) or removes (sign -1) an edge of a given value from
+ * the line counts of the cell at (i, j), if that cell is on the grid.
  */
-bool Grid::isSolved() const {
-    if (numOpenLoops_ != 0 || numClosedLoops_ != 1) {
-        return false;
+void Grid::countEdge(int i, int j, Edge edge, int sign) {
+    if (edge == EMPTY || i < 0 || i >= m_ || j < 0 || j >= n_) {
+        return;
     }
 
+    int k = i*stride_ + j;
+    unsigned char * count = (edge == LINE) ? &lineCounts_[k] : &nlineCounts_[k];
+
+    countClue(k, -1);
+    record(count);
+    *count += sign;
+    countClue(k, 1);
+}
+
+/*
+ * Counts the lines around every cell and the clues they leave
+ * unsatisfied or violated from scratch.
+ */
+void Grid::recountClues() {
+    unsatisfiedClues_ = 0;
+    violatedClues_ = 0;
+
     for (int i = 0; i < m_; i++) {
         for (int j = 0; j < n_; j++) {
-            if (!numberSatisfied(i,j)) {
-                return false;
+            Edge edges[4] = { getHLine(i, j), getHLine(i+1, j), getVLine(i, j), getVLine(i, j+1) };
+            int k = i*stride_ + j;
+
+            lineCounts_[k] = 0;
+            nlineCounts_[k] = 0;
+            for (int e = 0; e < 4; e++) {
+                lineCounts_[k] += (edges[e] == LINE);
+                nlineCounts_[k] += (edges[e] == NLINE);
             }
+            countClue(k, 1);
         }
     }
-
-    return true;
 }
 
 /*
- * Checks if there are any closed contours with the intention of detecting
- * prematurely closed contours
+ * Adds (sign 1) or removes (sign -1) an edge of a given value from the
+ * degree counts of the point at a given offset in the vertex plane.
  */
-bool Grid::containsClosedContours() const {
-    return (numClosedLoops_>0);
+void Grid::countVertex(int p, Edge edge, int sign) {
+    if (edge == LINE) {
+        record(&vertexLines_[p]);
+        vertexLines_[p] += sign;
+    } else if (edge == EMPTY) {
+        record(&vertexEmpties_[p]);
+        vertexEmpties_[p] += sign;
+    }
 }
 
-void Grid::initUpdateMatrix() {
+/*
+ * Marks the grid invalid if the point at a given offset can no longer
+ * be on a loop, because it has more than two lines or because it has
+ * a single line and no edge left to continue it.
+ */
+void Grid::checkVertex(int p) {
+    if (vertexLines_[p] > 2 || (vertexLines_[p] == 1 && vertexEmpties_[p] == 0)) {
+        valid_ = false;
+    }
+}
 
-    if (!init_) {
-        updateMatrix_ = new bool*[m_];
-        for (int i = 0; i < getHeight(); i++) {
-            updateMatrix_[i] = new bool[n_];
-            for (int j = 0; j < getWidth(); j++) {
-                updateMatrix_[i][j] = true;
+/*
+ * Counts the lines and empty edges at every point from scratch. Edges
+ * that would leave the lattice do not count towards either.
+ */
+void Grid::recountVertices() {
+    for (int i = 0; i < m_+1; i++) {
+        for (int j = 0; j < n_+1; j++) {
+            int p = i*stride_ + j;
+            vertexLines_[p] = 0;
+            vertexEmpties_[p] = 0;
+            if (j > 0) {
+                countVertex(p, getHLine(i, j-1), 1);
             }
-        }
-        contraMatrix_ = new bool*[m_];
-        for (int i = 0; i < getHeight(); i++) {
-            contraMatrix_[i] = new bool[n_];
-            for (int j = 0; j < getWidth(); j++) {
-                contraMatrix_[i][j] = false;
+            if (j < n_) {
+                countVertex(p, getHLine(i, j), 1);
             }
-        }
-        contourMatrix_ = new std::pair<int,int>*[m_+1];
-        for (int i = 0; i < getHeight()+1; i++) {
-            contourMatrix_[i] = new std::pair<int,int>[n_+1];
-            for (int j = 0; j < getWidth()+1; j++) {
-                contourMatrix_[i][j] = std::make_pair<int,int>(-1,-1);
+            if (i > 0) {
+                countVertex(p, getVLine(i-1, j), 1);
+            }
+            if (i < m_) {
+                countVertex(p, getVLine(i, j), 1);
             }
         }
-        numOpenLoops_ = 0;
-        numClosedLoops_ = 0;
     }
-
-    init_ = true;
-};
+}
 
 /*
  * Updates the information on the endpoints of our contours according to what
- * new line has been added. We use this 2D array to keep track of the endpoints now
- * instead of a vector. Also keeps track of the current number of open
- * and closed loops in our grid
+ * new line has been added. We use this plane to keep track of the endpoints now
+ * instead of a vector; each endpoint holds the index of the point at the other
+ * end of its contour. Also keeps track of the current number of open
+ * and closed loops in our grid. Returns one end of the contour the line
+ * became part of, or -1 if the line closed it.
  */
-void Grid::updateContourMatrix(int i, int j, bool hline) {
-
-    int i2 = i;
-    int j2 = j;
-
+int Grid::updateContourMatrix(int i, int j, bool hline) {
     // The second endpoint of the new line is determined by whether the line is
     // horizontal or vertical
-    if (hline) {
-        j2 = j + 1;
-    } else {
-        i2 = i + 1;
-    }
+    int p = i*stride_ + j;
+    int q = hline ? p + 1 : p + stride_;
+
+    int pEnd = getContourMatrix(p);
+    int qEnd = getContourMatrix(q);
 
     /* Both ends of the new line are already endpoints to a single contour.
        So get rid of both open endpoints and add one count of a closed loop. */
-    if (getContourMatrix(i,j).first == i2 && getContourMatrix(i,j).second == j2 && getContourMatrix(i2,j2).first == i && getContourMatrix(i2,j2).second == j) {
-        setContourMatrix(i,j,std::make_pair(-1,-1));
-        setContourMatrix(i2,j2,std::make_pair(-1,-1));
+    if (pEnd == q && qEnd == p) {
+        setContourMatrix(p, -1);
+        setContourMatrix(q, -1);
         numClosedLoops_++;
         numOpenLoops_--;
+        return -1;
     }
     /* Both ends of the new line are already endpoints to two different
      * conoturs. Get rid of the open endpoints, update the new ends of the
      * merged contour, and count one less open contour */
-    else if (getContourMatrix(i,j).first != -1 && getContourMatrix(i2,j2).first != -1) {
-        setContourMatrix(getContourMatrix(i,j).first,getContourMatrix(i,j).second,getContourMatrix(i2,j2));
-        setContourMatrix(getContourMatrix(i2,j2).first,getContourMatrix(i2,j2).second,getContourMatrix(i,j));
-        setContourMatrix(i,j,std::make_pair(-1,-1));
-        setContourMatrix(i2,j2,std::make_pair(-1,-1));
+    else if (pEnd != -1 && qEnd != -1) {
+        setContourMatrix(pEnd, qEnd);
+        setContourMatrix(qEnd, pEnd);
+        setContourMatrix(p, -1);
+        setContourMatrix(q, -1);
         numOpenLoops_--;
+        return pEnd;
     }
     /* First end of the new line is already an endpoint to a contour. Extend
      * the contour and update new endpoints. */
-    else if (getContourMatrix(i,j).first != -1) {
-        setContourMatrix(getContourMatrix(i,j).first,getContourMatrix(i,j).second,std::make_pair(i2,j2));
-        setContourMatrix(i2,j2,getContourMatrix(i,j));
-        setContourMatrix(i,j,std::make_pair(-1,-1));
+    else if (pEnd != -1) {
+        setContourMatrix(pEnd, q);
+        setContourMatrix(q, pEnd);
+        setContourMatrix(p, -1);
+        return q;
     }
     /* Second end of the new line is already an endpoint to a contour. Extend
      * the contour and update new endpoints. */
-    else if (getContourMatrix(i2,j2).first != -1) {
-        setContourMatrix(getContourMatrix(i2,j2).first,getContourMatrix(i2,j2).second,std::make_pair(i,j));
-        setContourMatrix(i,j,getContourMatrix(i2,j2));
-        setContourMatrix(i2,j2,std::make_pair(-1,-1));
+    else if (qEnd != -1) {
+        setContourMatrix(qEnd, p);
+        setContourMatrix(p, qEnd);
+        setContourMatrix(q, -1);
+        return p;
     }
     /* Neither end of new line is shared by a contour, so create a new contour
-     * with endpoints (i,j) and (i,j+1) */
+     * with endpoints p and q */
     else {
-        setContourMatrix(i,j,std::make_pair(i2,j2));
-        setContourMatrix(i2,j2,std::make_pair(i,j));
+        setContourMatrix(p, q);
+        setContourMatrix(q, p);
         numOpenLoops_++;
+        return p;
+    }
+}
+
+/*
+ * Sets NLINE on the edge joining the two ends of a contour when a line
+ * there would close a loop that is not the solution, checking both the
+ * contour that ends at point p and the one contour that was left open
+ * earlier because closing it would have solved the puzzle. That contour
+ * can no longer be closed once a second contour exists.
+ */
+void Grid::preventEarlyClosures(int p) {
+    if (p != -1) {
+        preventEarlyClosure(p);
+    }
+
+    if (pendingClosure_ != -1 && numOpenLoops_ > 1) {
+        int pending = pendingClosure_;
+        pendingClosure_ = -1;
+        preventEarlyClosure(pending);
+    }
+}
+
+/*
+ * Looks at the contour that ends at point p. If its two ends are next
+ * to each other, a line between them closes a loop, which is only
+ * right if that loop is the only contour and satisfies every number.
+ * Otherwise the edge between them must be NLINE.
+ */
+void Grid::preventEarlyClosure(int p) {
+    int q = getContourMatrix(p);
+    if (q == -1) {
+        return;
+    }
+    if (q < p) {
+        std::swap(p, q);
+    }
+
+    int i = p / stride_;
+    int j = p % stride_;
+    bool hline;
+    if (q == p + 1 && j < n_) {
+        hline = true;
+    } else if (q == p + stride_) {
+        hline = false;
+    } else {
+        return;
+    }
+
+    if ((hline ? getHLine(i, j) : getVLine(i, j)) != EMPTY) {
+        return;
+    }
+
+    fewestLoopsChecked_ = std::min(fewestLoopsChecked_, numOpenLoops_);
+    if (numOpenLoops_ == 1 && closureSolves(i, j, hline)) {
+        pendingClosure_ = p;
+        return;
+    }
+
+    /* the edge follows from the whole contour rather than from what
+     * set the line that led here */
+    int cause = cause_;
+    cause_ = NO_CAUSE;
+    if (hline) {
+        setHLine(i, j, NLINE);
+    } else {
+        setVLine(i, j, NLINE);
+    }
+    cause_ = cause;
+}
+
+/*
+ * Checks whether adding a line at the given edge would leave every
+ * number satisfied, using the counts of the cells on either side.
+ */
+bool Grid::closureSolves(int i, int j, bool hline) const {
+    int unsatisfied = unsatisfiedClues_;
+
+    Coordinates cells[2] = { hline ? Coordinates { i-1, j } : Coordinates { i, j-1 }, Coordinates { i, j } };
+    for (int c = 0; c < 2; c++) {
+        if (cells[c].i < 0 || cells[c].i >= m_ || cells[c].j < 0 || cells[c].j >= n_) {
+            continue;
+        }
+
+        int k = cells[c].i*stride_ + cells[c].j;
+        if (numbers_[k] != NONE) {
+            int value = numbers_[k] - ZERO;
+            unsatisfied += (lineCounts_[k] + 1 != value) - (lineCounts_[k] != value);
+        }
+    }
+
+    return unsatisfied == 0;
+}
+
+/*
+ * Starts recording changes to the grid so that they can be undone with
+ * rollback(). While at least one checkpoint is open every edge, contour
+ * and dirty flag change is pushed on the trail, so a guess costs time in
+ * proportion to the deductions it makes rather than to the grid area.
+ * Checkpoints nest.
+ */
+void Grid::pushCheckpoint() {
+    Checkpoint checkpoint;
+    checkpoint.trailSize = trail_.size();
+    checkpoint.numOpenLoops = numOpenLoops_;
+    checkpoint.numClosedLoops = numClosedLoops_;
+    checkpoint.unsatisfiedClues = unsatisfiedClues_;
+    checkpoint.violatedClues = violatedClues_;
+    checkpoint.pendingClosure = pendingClosure_;
+    checkpoint.hash = hash_;
+    checkpoint.valid = valid_;
+    checkpoint.updated = updated_;
+    checkpoint.changesSize = changes_.size();
+    for (int q = 0; q < NUM_QUEUES; q++) {
+        checkpoint.fullSweep[q] = fullSweep_[q];
+        checkpoint.changesHead[q] = changesHead_[q];
+    }
+    checkpoints_.push_back(checkpoint);
+}
+
+/*
+ * Undoes every change made since the most recent checkpoint and
+ * removes that checkpoint.
+ */
+void Grid::rollback() {
+    assert(!checkpoints_.empty());
+
+    Checkpoint checkpoint = checkpoints_.back();
+    checkpoints_.pop_back();
+
+    for (int k = trail_.size() - 1; k >= checkpoint.trailSize; k--) {
+        TrailEntry const & entry = trail_[k];
+        if (entry.wide) {
+            *(int *)(block_ + entry.offset) = entry.value;
+        } else {
+            block_[entry.offset] = entry.value;
+        }
+    }
+    trail_.resize(checkpoint.trailSize);
+
+    numOpenLoops_ = checkpoint.numOpenLoops;
+    numClosedLoops_ = checkpoint.numClosedLoops;
+    unsatisfiedClues_ = checkpoint.unsatisfiedClues;
+    violatedClues_ = checkpoint.violatedClues;
+    pendingClosure_ = checkpoint.pendingClosure;
+    hash_ = checkpoint.hash;
+    valid_ = checkpoint.valid;
+    updated_ = checkpoint.updated;
+    changes_.resize(checkpoint.changesSize);
+    for (int q = 0; q < NUM_QUEUES; q++) {
+        fullSweep_[q] = checkpoint.fullSweep[q];
+        changesHead_[q] = checkpoint.changesHead[q];
+    }
+}
+
+/*
+ * Collects every edge that has been set since the most recent checkpoint,
+ * in the order they were set, along with its current value.
+ */
+void Grid::getAssignments(std::vector<EdgeAssignment> & assignments) const {
+    assert(!checkpoints_.empty());
+
+    assignments.clear();
+
+    for (int k = checkpoints_.back().trailSize; k < trail_.size(); k++) {
+        if (trail_[k].wide || trail_[k].value != EMPTY) {
+            continue;
+        }
+
+        EdgeAssignment assignment = edgeAt(trail_[k].offset);
+        if (assignment.edge != EMPTY) {
+            assignments.push_back(assignment);
+        }
+    }
+}
+
+/*
+ * Adds to points both ends of every edge set since the most recent
+ * checkpoint, along with every point whose contour changed and the
+ * point it was joined to before, which together are every point whose
+ * state setting those edges depended on.
+ */
+void Grid::getTouchedPoints(std::vector<Coordinates> & points) const {
+    assert(!checkpoints_.empty());
+
+    int contourBytes = (m_+1) * stride_ * sizeof(int);
+    for (int k = checkpoints_.back().trailSize; k < trail_.size(); k++) {
+        TrailEntry const & entry = trail_[k];
+        int offset = entry.offset - (int)((unsigned char *)contourMatrix_ - block_);
+        if (entry.wide && 0 <= offset && offset < contourBytes) {
+            int p = offset / sizeof(int);
+            points.push_back(Coordinates { p / stride_, p % stride_ });
+            if (entry.value != -1) {
+                points.push_back(Coordinates { entry.value / stride_, entry.value % stride_ });
+            }
+            continue;
+        }
+
+        EdgeAssignment a = edgeAt(entry.offset);
+        if (!entry.wide && entry.value == EMPTY && a.edge != EMPTY) {
+            points.push_back(a.coords);
+            points.push_back(a.h ? Coordinates { a.coords.i, a.coords.j+1 } : Coordinates { a.coords.i+1, a.coords.j });
+        }
+    }
+}
+
+/*
+ * Sets each of the given edges, for the purpose of replaying the
+ * assignments made in a guess after rolling it back.
+ */
+void Grid::applyAssignments(std::vector<EdgeAssignment> const & assignments) {
+    for (int k = 0; k < assignments.size(); k++) {
+        EdgeAssignment const & a = assignments[k];
+        if (a.h) {
+            setValid(setHLine(a.coords.i, a.coords.j, a.edge));
+        } else {
+            setValid(setVLine(a.coords.i, a.coords.j, a.edge));
+        }
+    }
+}
+
+/*
+ * Sets each of the given edges as following from the given causes,
+ * for the purpose of replaying the deductions of a solver that knew
+ * what each of them followed from.
+ */
+void Grid::applyAssignments(std::vector<EdgeAssignment> const & assignments, std::vector<int> const & causes) {
+    assert(assignments.size() == causes.size());
+
+    for (int k = 0; k < assignments.size(); k++) {
+        EdgeAssignment const & a = assignments[k];
+        cause_ = causes[k];
+        if (a.h) {
+            setValid(setHLine(a.coords.i, a.coords.j, a.edge));
+        } else {
+            setValid(setVLine(a.coords.i, a.coords.j, a.edge));
+        }
+    }
+    cause_ = NO_CAUSE;
+}
+
+/*
+ * Collects the edges that have been set since the change count was
+ * mark, in the order they were set, along with their values.
+ */
+void Grid::getChangesSince(int mark, std::vector<EdgeAssignment> & changes) const {
+    assert(0 <= mark && mark <= changes_.size());
+
+    changes.clear();
+    for (int k = mark; k < changes_.size(); k++) {
+        changes.push_back(edgeAt(changes_[k]));
+    }
+}
+
+/*
+ * Collects the edges that have been set since the change count was
+ * mark along with what each of them followed from.
+ */
+void Grid::getChangesSince(int mark, std::vector<EdgeAssignment> & changes, std::vector<int> & causes) const {
+    getChangesSince(mark, changes);
+
+    causes.clear();
+    for (int k = 0; k < changes.size(); k++) {
+        causes.push_back(getCause(getEdgeIndex(changes[k].coords.i, changes[k].coords.j, changes[k].h)));
+    }
+}
+
+/*
+ * Collects the edges that the given queue has not seen yet, in the
+ * order they were set.
+ */
+void Grid::getPendingChanges(ChangeQueue q, std::vector<EdgeAssignment> & changes) const {
+    getChangesSince(changesHead_[q], changes);
+}
+
+/*
+ * Takes the oldest edge that the given queue has not seen yet. Edges
+ * are queued in the order they are set, so rules are woken in the same
+ * order the deductions that trigger them were made.
+ */
+EdgeAssignment Grid::popChange(ChangeQueue q) {
+    assert(hasChanges(q));
+
+    EdgeAssignment change = edgeAt(changes_[changesHead_[q]++]);
+    trimChanges();
+    return change;
+}
+
+/*
+ * Marks every queued edge as seen by the given queue, for when a full
+ * sweep is about to look at all of them anyway.
+ */
+void Grid::discardChanges(ChangeQueue q) {
+    changesHead_[q] = changes_.size();
+    trimChanges();
+}
+
+/*
+ * Empties the queue of changes and asks for a full sweep of rules and
+ * contradictions, for a grid that has been filled in from scratch.
+ */
+void Grid::clearChanges() {
+    changes_.clear();
+    for (int q = 0; q < NUM_QUEUES; q++) {
+        changesHead_[q] = 0;
+        fullSweep_[q] = true;
+    }
+}
+
+/*
+ * Frees the queue once every edge on it has been seen by both rules
+ * and contradictions. While a checkpoint is open the queue is left
+ * alone, since rolling back must be able to restore it.
+ */
+void Grid::trimChanges() {
+    if (!checkpoints_.empty()) {
+        return;
+    }
+    for (int q = 0; q < NUM_QUEUES; q++) {
+        if (changesHead_[q] < changes_.size()) {
+            return;
+        }
+    }
+
+    changes_.clear();
+    for (int q = 0; q < NUM_QUEUES; q++) {
+        changesHead_[q] = 0;
+    }
+}
+
+/*
+ * Gives the edge at a given offset in the block along with its
+ * current value, or an EMPTY assignment if the offset is not on
+ * an edge plane.
+ */
+EdgeAssignment Grid::edgeAt(int offset) const {
+    int hlineStart = getHLineStart();
+    int vlineStart = getVLineStart();
+
+    if (hlineStart <= offset && offset < hlineStart + (m_+1) * stride_) {
+        int i = (offset - hlineStart) / stride_;
+        int j = (offset - hlineStart) % stride_;
+        return EdgeAssignment { Coordinates { i, j }, getHLine(i, j), true };
+    } else if (vlineStart <= offset && offset < vlineStart + m_ * stride_) {
+        int i = (offset - vlineStart) / stride_;
+        int j = (offset - vlineStart) % stride_;
+        return EdgeAssignment { Coordinates { i, j }, getVLine(i, j), false };
+    }
+    return EdgeAssignment { Coordinates { -1, -1 }, EMPTY, false };
+}
+
+/*
+ * Gives the random key that an edge at a given offset in the block
+ * contributes to the hash when it has a given value. Empty edges
+ * contribute nothing, so setting an edge is a single xor. The keys
+ * are mixed from the offset and value rather than stored, so every
+ * grid of the same dimensions agrees on them.
+ */
+uint64_t Grid::edgeKey(int offset, Edge edge) {
+    if (edge == EMPTY) {
+        return 0;
+    }
+
+    uint64_t z = (uint64_t)(offset * 4 + edge) * 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/*
+ * Puts each cell, and the outside, in a set of its own, recording the
+ * change so that rolling back restores the sets as they were.
+ */
+void Grid::resetColors() {
+    for (int c = 0; c <= m_*n_; c++) {
+        setColorParent(c, c, 0);
+        setColorNext(c, c);
+        setColorSize(c, 1);
+    }
+}
+
+/*
+ * Computes the hash of every edge of the grid from scratch.
+ */
+void Grid::rehash() {
+    hash_ = 0;
+    for (int i = 0; i < m_+1; i++) {
+        for (int j = 0; j < n_; j++) {
+            hash_ ^= edgeKey((unsigned char *)&hlines_[i*stride_ + j] - block_, hlines_[i*stride_ + j]);
+        }
+    }
+    for (int i = 0; i < m_; i++) {
+        for (int j = 0; j < n_+1; j++) {
+            hash_ ^= edgeKey((unsigned char *)&vlines_[i*stride_ + j] - block_, vlines_[i*stride_ + j]);
+        }
     }
 }
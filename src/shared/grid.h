@@ -1,45 +1,184 @@
 #ifndef GRID_H
 #define GRID_H
 #include "lattice.h"
+#include <climits>
+#include <stdint.h>
 #include <vector>
+#include "constants.h"
 #include "enums.h"
 #include "contour.h"
+#include "structs.h"
 
 class Grid : public Lattice {
     public:
         Grid() { };
-        ~Grid();
         void initUpdateMatrix();
+        virtual void setNumber(int i, int j, Number num);
         virtual bool setHLine(int i, int j, Edge edge);
         virtual bool setVLine(int i, int j, Edge edge);
         virtual bool changeHLine(int i, int j, Edge edge);
         virtual bool changeVLine(int i, int j, Edge edge);
         bool numberSatisfied(int i, int j) const;
-        bool isSolved() const;
+        bool isSolved() const { return numOpenLoops_ == 0 && numClosedLoops_ == 1 && unsatisfiedClues_ == 0; };
+        bool hasViolatedClues() const { return violatedClues_ > 0; };
+        int getLineCount(int i, int j) const { return lineCounts_[i*stride_ + j]; };
+        int getNLineCount(int i, int j) const { return nlineCounts_[i*stride_ + j]; };
+        int getVertexLines(int i, int j) const { return vertexLines_[i*stride_ + j]; };
+        int getVertexEmpties(int i, int j) const { return vertexEmpties_[i*stride_ + j]; };
         void copy(Grid & newGrid) const;
         void clearAndCopy(Grid & newGrid);
         bool getValid() const { return valid_; };
         void setValid(bool validity) { valid_ = validity && valid_; };
         void resetGrid();
         bool containsClosedContours() const;
-        bool getUpdateMatrix(int i, int j) const { return updateMatrix_[i][j]; };
-        bool getContraMatrix(int i, int j) const { return contraMatrix_[i][j]; };
-        void setUpdateMatrix(int i, int j, bool b) { updateMatrix_[i][j] = b; };
-        void setContraMatrix(int i, int j, bool b) { contraMatrix_[i][j] = b; };
+
+        uint64_t getHash() const { return hash_; };
+        void markClosureChecks() { fewestLoopsChecked_ = INT_MAX; };
+        int getFewestLoopsChecked() const { return fewestLoopsChecked_; };
+        int getOpenLoops() const { return numOpenLoops_; };
+        bool hasPendingClosure() const { return pendingClosure_ != -1; };
+        bool isContourEnd(int i, int j) const { return contourMatrix_[i*stride_ + j] != -1; };
+
+        int getEdgeIndex(int i, int j, bool hline) const { return (hline ? 0 : (m_+1)*stride_) + i*stride_ + j; };
+        int getEdgeCount() const { return 2 * (m_+1) * stride_; };
+        int getCause(int edge) const { return causes_[edge]; };
+        void setCause(int cause) { cause_ = cause; };
+
+        int getColorParent(int c) const { return colorLinks_[c] >> 1; };
+        int getColorParity(int c) const { return colorLinks_[c] & 1; };
+        int getColorNext(int c) const { return colorNext_[c]; };
+        int getColorSize(int c) const { return colorSizes_[c]; };
+        void setColorParent(int c, int parent, int parity) {
+            record(&colorLinks_[c]);
+            colorLinks_[c] = 2*parent + parity;
+        };
+        void setColorNext(int c, int next) {
+            record(&colorNext_[c]);
+            colorNext_[c] = next;
+        };
+        void setColorSize(int c, int size) {
+            record(&colorSizes_[c]);
+            colorSizes_[c] = size;
+        };
+        void resetColors();
+
+        bool getFullSweep(ChangeQueue q) const { return fullSweep_[q]; };
+        void setFullSweep(ChangeQueue q, bool fullSweep) { fullSweep_[q] = fullSweep; };
+        bool hasChanges(ChangeQueue q) const { return changesHead_[q] < changes_.size(); };
+        EdgeAssignment peekChange(ChangeQueue q) const { return edgeAt(changes_[changesHead_[q]]); };
+        EdgeAssignment popChange(ChangeQueue q);
+        void discardChanges(ChangeQueue q);
+        int getChangeCount() const { return changes_.size(); };
+        void getChangesSince(int mark, std::vector<EdgeAssignment> & changes) const;
+        void getChangesSince(int mark, std::vector<EdgeAssignment> & changes, std::vector<int> & causes) const;
+        void getPendingChanges(ChangeQueue q, std::vector<EdgeAssignment> & changes) const;
+
+        void pushCheckpoint();
+        void rollback();
+        int getCheckpointDepth() const { return checkpoints_.size(); };
+        void getAssignments(std::vector<EdgeAssignment> & assignments) const;
+        void getTouchedPoints(std::vector<Coordinates> & points) const;
+        void applyAssignments(std::vector<EdgeAssignment> const & assignments);
+        void applyAssignments(std::vector<EdgeAssignment> const & assignments, std::vector<int> const & causes);
+
+    protected:
+        virtual size_t extraBytes() const;
 
     private:
+        /* One change to a byte or an int in the block, recorded so that
+         * it can be undone when rolling back to a checkpoint */
+        struct TrailEntry {
+            int offset;
+            int value;
+            bool wide;
+        };
+
+        /* State of the grid that lives outside the block, along with
+         * the length of the trail, at the time of a checkpoint */
+        struct Checkpoint {
+            int trailSize;
+            int numOpenLoops;
+            int numClosedLoops;
+            int unsatisfiedClues;
+            int violatedClues;
+            int pendingClosure;
+            uint64_t hash;
+            bool valid;
+            bool updated;
+            bool fullSweep[NUM_QUEUES];
+            int changesSize;
+            int changesHead[NUM_QUEUES];
+        };
+
+        void record(unsigned char * p) {
+            if (!checkpoints_.empty()) {
+                trail_.push_back(TrailEntry { (int)(p - block_), *p, false });
+            }
+        };
+        void record(int * p) {
+            if (!checkpoints_.empty()) {
+                trail_.push_back(TrailEntry { (int)((unsigned char *)p - block_), *p, true });
+            }
+        };
+
+        void logChange(Edge * p) { changes_.push_back((unsigned char *)p - block_); };
+        EdgeAssignment edgeAt(int offset) const;
+        void clearChanges();
+        void trimChanges();
+
+        void countClue(int k, int sign);
+        void countEdge(int i, int j, Edge edge, int sign);
+        void recountClues();
+        void countVertex(int p, Edge edge, int sign);
+        void checkVertex(int p);
+        void recountVertices();
+
+        static uint64_t edgeKey(int offset, Edge edge);
+        void hashEdge(Edge * p, Edge prevEdge, Edge edge) {
+            int offset = (unsigned char *)p - block_;
+            hash_ ^= edgeKey(offset, prevEdge) ^ edgeKey(offset, edge);
+        };
+        void rehash();
+
         void mergeContours(Contour & newContour);
-        void updateContourMatrix(int i, int j, bool hline);
-        bool ** updateMatrix_;
-        bool ** contraMatrix_;
-        std::pair<int,int> ** contourMatrix_;
+        int updateContourMatrix(int i, int j, bool hline);
+        void preventEarlyClosures(int p);
+        void preventEarlyClosure(int p);
+        bool closureSolves(int i, int j, bool hline) const;
+        int * contourMatrix_;   /* other endpoint of the contour ending at each point, or -1 */
+        unsigned char * lineCounts_;    /* LINE edges around each cell */
+        unsigned char * nlineCounts_;   /* NLINE edges around each cell */
+        unsigned char * vertexLines_;   /* LINE edges at each point */
+        unsigned char * vertexEmpties_; /* EMPTY edges at each point */
+        int * causes_;          /* what set each edge, by edge index: a rule in place, a nogood or NO_CAUSE */
+        int * colorLinks_;      /* for each cell, and the outside after them, twice the cell it hangs from plus whether the two differ */
+        int * colorNext_;       /* the next cell of the same set of cells, round a ring */
+        int * colorSizes_;      /* how many cells the set of each cell standing for one counts as */
+        int cause_;             /* what the edges being set follow from */
+        int unsatisfiedClues_;  /* numbers without exactly their number of lines */
+        int violatedClues_;     /* numbers with too many lines or too few edges left for them */
+        int pendingClosure_;    /* end of the only contour, if closing it would solve the puzzle, or -1 */
+        uint64_t hash_;         /* Zobrist hash of the edges */
         bool valid_ = true;
-        bool init_ = false;
         int numOpenLoops_;
         int numClosedLoops_;
+        int fewestLoopsChecked_;    /* fewest open contours at a closure check since the mark, kept through rollbacks */
+        std::vector<TrailEntry> trail_;
+        std::vector<Checkpoint> checkpoints_;
+        /* Edges that have been set, in order, as offsets in the block.
+         * Rules, contradictions and the cache of probes each consume
+         * the queue from their own head, and each has to look at the
+         * whole grid when it is fresh before the queue alone can tell
+         * it where to look. */
+        std::vector<int> changes_;
+        int changesHead_[NUM_QUEUES];
+        bool fullSweep_[NUM_QUEUES];
 
-        std::pair<int,int> getContourMatrix(int i, int j) { return contourMatrix_[i][j]; };
-        void setContourMatrix(int i, int j, std::pair<int,int> p) { contourMatrix_[i][j] = p; };
+        int getContourMatrix(int p) const { return contourMatrix_[p]; };
+        void setContourMatrix(int p, int q) {
+            record(&contourMatrix_[p]);
+            contourMatrix_[p] = q;
+        };
 };
 
 #endif
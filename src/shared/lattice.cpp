@@ -1,5 +1,6 @@
 #include "lattice.h"
 #include <cassert>
+#include <cstring>
 #include "enums.h"
 
 #define POINT '.'
@@ -14,72 +15,53 @@ Lattice::~Lattice() {
     destroyArrays();
 }
 
-/* Initializes the three two dimensional arrays used to
- * represent a lattice, one each for numbers, horizontal
- * lines, and vertical lines. Sets the init_ variable to
- * true so that the destructor knows to free the memory
- * after destroying an instance of the class. */
+/* Initializes the three planes used to represent a lattice,
+ * one each for numbers, horizontal lines, and vertical lines.
+ * All three live in a single block along with any state a
+ * subclass asks for through extraBytes(), and share one row
+ * stride, so that copying a lattice is a single memcpy. If
+ * the lattice already has a block of the right dimensions it
+ * is reused. Sets the init_ variable to true so that the
+ * destructor knows to free the memory after destroying an
+ * instance of the class. */
 void Lattice::initArrays(int m, int n) {
     assert(m > 0 && n > 0);
 
-    destroyArrays();
-
-    m_ = m;
-    n_ = n;
-
-    numbers_ = new Number*[m_];
-    hlines_ = new Edge*[m_+1];
-    vlines_ = new Edge*[m_];
-    for (int i = 0; i < m_; i++) {
-        numbers_[i] = new Number[n_];
-        hlines_[i] = new Edge[n_];
-        vlines_[i] = new Edge[n_+1];
-    }
-    // hlines_ needs one extra
-    hlines_[m_] = new Edge[n_];
-
-    init_ = true;
-
-    cleanArrays();
-}
-
-/* Get value of number located at coordinates (i, j),
- * where i is on the range [0, m_+1] and j is on the
- * range [0, n_]. */
-Number Lattice::getNumber(int i, int j) const {
-    assert(0 <= i && i < m_ && 0 <= j && j < n_);
+    if (!init_ || m != m_ || n != n_) {
+        destroyArrays();
 
-    return numbers_[i][j];
-}
+        m_ = m;
+        n_ = n;
 
-/* Get value of horizontal edge located at coordinates
- * (i, j), where i is on the range [0, m_+1] and j is
- * on the range [0, n_]. */
-Edge Lattice::getHLine(int i, int j) const {
-    assert(0 <= i && i < m_+1 && 0 <= j && j < n_);
+        // every plane is at most n_+1 wide; pad rows to 8 bytes
+        stride_ = (n_ + 1 + 7) & ~7;
+        size_t numberBytes = alignPlane(m_ * stride_ * sizeof(Number));
+        size_t hlineBytes = alignPlane((m_+1) * stride_ * sizeof(Edge));
+        size_t vlineBytes = alignPlane(m_ * stride_ * sizeof(Edge));
+        latticeBytes_ = numberBytes + hlineBytes + vlineBytes;
+        blockBytes_ = latticeBytes_ + alignPlane(extraBytes());
 
-    return hlines_[i][j];
-}
+        block_ = new unsigned char[blockBytes_];
+        numbers_ = (Number *)block_;
+        hlines_ = (Edge *)(block_ + numberBytes);
+        vlines_ = (Edge *)(block_ + numberBytes + hlineBytes);
 
-/* Get value of vertical edge located at coordinates
- * (i, j), where i is on the range [0, m_+1] and j is
- * on the range [0, n_]. */
-Edge Lattice::getVLine(int i, int j) const {
-    assert(0 <= i && i < m_ && 0 <= j && j < n_+1);
+        init_ = true;
+    }
 
-    return vlines_[i][j];
+    cleanArrays();
 }
 
 /* Get value of horizontal edge located at coordinates
  * (i, j), with no restriction on where they can be obtained. */
 Edge Lattice::checkEdgeH(int i, int j) const {
-    return hlines_[i][j];
+    return hlines_[i*stride_ + j];
 }
 
 /* Get value of vertical edge located at coordinates
  * (i, j), with no restriction on where they can be obtained. */
 Edge Lattice::checkEdgeV(int i, int j) const {
-    return vlines_[i][j];
+    return vlines_[i*stride_ + j];
 }
 
 
@@ -89,7 +71,7 @@ Edge Lattice::checkEdgeV(int i, int j) const {
 void Lattice::setNumber(int i, int j, Number num) {
     assert(0 <= i && i < m_ && 0 <= j && j < n_);
 
-    numbers_[i][j] = num;
+    numbers_[i*stride_ + j] = num;
 }
 
 /* Set value of horizontal edge located at coordinates
@@ -98,7 +80,7 @@ void Lattice::setNumber(int i, int j, Number num) {
 bool Lattice::setHLine(int i, int j, Edge edge) {
     assert(0 <= i && i < m_+1 && 0 <= j && j < n_);
 
-    hlines_[i][j] = edge;
+    hlines_[i*stride_ + j] = edge;
     return true;
 }
 
@@ -108,44 +90,24 @@ bool Lattice::setHLine(int i, int j, Edge edge) {
 bool Lattice::setVLine(int i, int j, Edge edge) {
     assert(0 <= i && i < m_ && 0 <= j && j < n_+1);
 
-    vlines_[i][j] = edge;
+    vlines_[i*stride_ + j] = edge;
     return true;
 }
 
-/* Deallocates any data allocated in the three two
- * dimensional arrays used to represent the lattice */
+/* Deallocates the block holding every plane of the lattice */
 void Lattice::destroyArrays() {
     if (init_) {
-        for (int i = 0; i < m_; i++) {
-            delete [] numbers_[i];
-            delete [] hlines_[i];
-            delete [] vlines_[i];
-        }
-        // hlines_ needs one extra
-        delete [] hlines_[m_];
-        // and delete the outer arrays
-        delete [] numbers_;
-        delete [] hlines_;
-        delete [] vlines_;
+        delete [] block_;
+        init_ = false;
     }
 }
 
-/* Wipes out all data from the three two dimensional
- * arrays so that new data can be added on top of a
- * clean grid. */
+/* Wipes out all data from the lattice planes so that new
+ * data can be added on top of a clean grid. Padding between
+ * rows is cleared as well, which keeps the block comparable
+ * and copyable byte for byte. */
 void Lattice::cleanArrays() {
     if (init_) {
-        for (int i = 0; i < m_; i++) {
-            for (int j = 0; j < n_; j++) {
-                numbers_[i][j] = NONE;
-                hlines_[i][j] = EMPTY;
-                vlines_[i][j] = EMPTY;
-            }
-            vlines_[i][n_] = EMPTY;
-        }
-
-        for (int j = 0; j < n_; j++) {
-            hlines_[m_][j] = EMPTY;
-        }
+        memset(block_, 0, latticeBytes_);
     }
 }
@@ -1,28 +1,47 @@
 #ifndef LATTICE_H
 #define LATTICE_H
+#include <cassert>
+#include <cstddef>
 #include <string>
 #include "enums.h"
 
 class Lattice {
     public:
         Lattice() { };
-        ~Lattice();
+        virtual ~Lattice();
         void initArrays(int m, int n);
 
         bool getUpdated() const { return updated_; };
         void setUpdated(bool updated) { updated_ = updated; };
         int getHeight() const { return m_; };
         int getWidth() const { return n_; };
-        Number getNumber(int i, int j) const;
-        Edge getHLine(int i, int j) const;
-        Edge getVLine(int i, int j) const;
+        int getStride() const { return stride_; };
+        unsigned char const * getCells() const { return block_; };
+        int getHLineStart() const { return (unsigned char *)hlines_ - block_; };
+        int getVLineStart() const { return (unsigned char *)vlines_ - block_; };
+        Number getNumber(int i, int j) const {
+            assert(0 <= i && i < m_ && 0 <= j && j < n_);
+            return numbers_[i*stride_ + j];
+        };
+        Edge getHLine(int i, int j) const {
+            assert(0 <= i && i < m_+1 && 0 <= j && j < n_);
+            return hlines_[i*stride_ + j];
+        };
+        Edge getVLine(int i, int j) const {
+            assert(0 <= i && i < m_ && 0 <= j && j < n_+1);
+            return vlines_[i*stride_ + j];
+        };
         Edge checkEdgeH(int i, int j) const;
         Edge checkEdgeV(int i, int j) const;
-        void setNumber(int i, int j, Number num);
+        virtual void setNumber(int i, int j, Number num);
         virtual bool setHLine(int i, int j, Edge edge);
         virtual bool setVLine(int i, int j, Edge edge);
 
     protected:
+        /* Rounds a byte count up to a whole number of cache lines so
+         * that each plane in the block starts on its own line. */
+        static size_t alignPlane(size_t bytes) { return (bytes + 63) & ~(size_t)63; };
+        virtual size_t extraBytes() const { return 0; };
         void destroyArrays();
         void cleanArrays();
 
@@ -30,9 +49,13 @@ class Lattice {
         bool updated_ = true;
         int m_;     /* number of rows */
         int n_;     /* number of columns */
-        Number ** numbers_;
-        Edge ** hlines_;
-        Edge ** vlines_;
+        int stride_;    /* distance between rows in every plane */
+        size_t latticeBytes_;   /* bytes used by the three lattice planes */
+        size_t blockBytes_;     /* bytes in block_, including subclass state */
+        unsigned char * block_;
+        Number * numbers_;
+        Edge * hlines_;
+        Edge * vlines_;
 };
 
 #endif
@@ -18,6 +18,12 @@ struct EdgePosition {
     Edge edge;
 };
 
+struct EdgeAssignment {
+    Coordinates coords;
+    Edge edge;
+    bool h;
+};
+
 struct PrioEdge {
     Coordinates coords;
     double priority;
@@ -28,4 +34,19 @@ struct AdjacencyList {
     bool u, d, l, r;
 };
 
+struct SolverOptions {
+    Engine engine = RULE_ENGINE;    /* what solves the grid: rules and guesses, SAT, or rules and then SAT */
+    int threads = 1;
+    int tableMegabytes = 64;    /* 0 for no transposition table */
+    bool probeCache = true;     /* skip probes whose surroundings have not changed */
+    bool learning = true;       /* learn nogoods from guesses that fail */
+    bool coloring = true;       /* relate the colors of cells either side of the edges set */
+    bool connectivity = true;   /* keep the lines to one block of the edges not ruled out */
+    Ordering ordering = FLAT_ORDERING;  /* which heuristic ranks the edges to guess */
+    long ruleBudget = 0;        /* most rules a guess of the first solver may apply, 0 for no limit */
+    long guessBudget = 0;       /* most guesses that may be nested in it, 0 for no limit */
+    int timeBudget = 0;         /* most milliseconds it may take, 0 for no limit */
+    int guessRadius = 0;        /* first guess within this many points of the ends of contours, widening as needed; 0 to guess anywhere */
+};
+
 #endif
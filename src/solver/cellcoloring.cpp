@@ -0,0 +1,328 @@
+#include "cellcoloring.h"
+#include <vector>
+#include "../shared/enums.h"
+#include "../shared/grid.h"
+#include "../shared/structs.h"
+
+/* The cells that the edges around a number or a point lie between */
+static int const AROUND_NUMBER[4][2] = { { 0, 1 }, { 0, 2 }, { 0, 3 }, { 0, 4 } };
+static int const AROUND_POINT[4][2] = { { 0, 1 }, { 1, 2 }, { 2, 3 }, { 3, 0 } };
+
+/* Joins the cells on either side of each edge set since the last call,
+ * or of every edge set if the grid is fresh, settles the numbers and
+ * points around the cells that moved to another set until none has
+ * anything left to settle, then sets every edge that the colors decide.
+ * Fails the grid if an edge was set against the colors. Gives whether
+ * any edge was set. */
+bool CellColoring::propagate(Grid & grid) {
+    if (!grid.getFullSweep(COLOR_QUEUE) && !grid.hasChanges(COLOR_QUEUE)) {
+        return false;
+    }
+    grid_ = &grid;
+    resize();
+
+    bool consistent = true;
+    if (grid.getFullSweep(COLOR_QUEUE)) {
+        grid.setFullSweep(COLOR_QUEUE, false);
+        grid.discardChanges(COLOR_QUEUE);
+
+        /* the outside borders on every cell of the edge of the lattice,
+         * so it counts as that many cells, which keeps it from being
+         * walked round whenever a cell of the edge is joined to it */
+        grid.resetColors();
+        grid.setColorSize(outside_, 2 * (m_ + n_));
+        for (int i = 0; i < m_+1 && consistent; i++) {
+            for (int j = 0; j < n_+1 && consistent; j++) {
+                Edge edge = j < n_ ? grid.getHLine(i, j) : EMPTY;
+                if (edge != EMPTY) {
+                    consistent = join(cellOf(i-1, j), cellOf(i, j), edge == LINE);
+                }
+                edge = i < m_ ? grid.getVLine(i, j) : EMPTY;
+                if (edge != EMPTY && consistent) {
+                    consistent = join(cellOf(i, j-1), cellOf(i, j), edge == LINE);
+                }
+            }
+        }
+    } else {
+        while (consistent && grid.hasChanges(COLOR_QUEUE)) {
+            EdgeAssignment change = grid.popChange(COLOR_QUEUE);
+            int i = change.coords.i;
+            int j = change.coords.j;
+            if (change.h) {
+                consistent = join(cellOf(i-1, j), cellOf(i, j), change.edge == LINE);
+            } else {
+                consistent = join(cellOf(i, j-1), cellOf(i, j), change.edge == LINE);
+            }
+        }
+    }
+
+    while (consistent && (!numbers_.empty() || !points_.empty())) {
+        if (!numbers_.empty()) {
+            int c = numbers_.back();
+            numbers_.pop_back();
+            numberQueued_[c] = false;
+            consistent = settleNumber(c / n_, c % n_);
+        } else {
+            int p = points_.back();
+            points_.pop_back();
+            pointQueued_[p] = false;
+            consistent = settlePoint(p / (n_+1), p % (n_+1));
+        }
+    }
+    if (!consistent) {
+        clearQueues();
+        grid.setValid(false);
+        return false;
+    }
+
+    bool changed = setEdges();
+    grid.discardChanges(COLOR_QUEUE);
+    return changed;
+}
+
+/* Sizes the queues for the grid, unless they already are */
+void CellColoring::resize() {
+    if (grid_->getHeight() == m_ && grid_->getWidth() == n_) {
+        return;
+    }
+
+    m_ = grid_->getHeight();
+    n_ = grid_->getWidth();
+    outside_ = m_*n_;
+    numberQueued_.assign(m_*n_, false);
+    pointQueued_.assign((m_+1) * (n_+1), false);
+    numbers_.clear();
+    points_.clear();
+    edges_.clear();
+}
+
+/* Gives the cell at a place, or the outside if it is off the lattice */
+int CellColoring::cellOf(int i, int j) const {
+    if (i < 0 || i >= m_ || j < 0 || j >= n_) {
+        return outside_;
+    }
+    return i*n_ + j;
+}
+
+/* Gives the cell standing for the set of a cell, along with whether
+ * the two differ. The sets are joined smaller under larger, so the
+ * way up is short, and it is not shortened as it is walked, since
+ * every change to the sets goes on the trail of the grid. */
+int CellColoring::findRoot(int c, int & parity) const {
+    parity = 0;
+    while (grid_->getColorParent(c) != c) {
+        parity ^= grid_->getColorParity(c);
+        c = grid_->getColorParent(c);
+    }
+    return c;
+}
+
+/* Puts two cells in the same set, alike or different as the parity
+ * says, queueing what the cells of the smaller set touch to be looked
+ * at again. Gives false if they are already in the same set the other
+ * way. */
+bool CellColoring::join(int a, int b, int parity) {
+    int pa;
+    int pb;
+    int ra = findRoot(a, pa);
+    int rb = findRoot(b, pb);
+    if (ra == rb) {
+        return (pa ^ pb) == parity;
+    }
+
+    if (grid_->getColorSize(ra) < grid_->getColorSize(rb)) {
+        int r = ra;
+        ra = rb;
+        rb = r;
+    }
+    touchSet(rb);
+
+    int next = grid_->getColorNext(ra);
+    grid_->setColorNext(ra, grid_->getColorNext(rb));
+    grid_->setColorNext(rb, next);
+    grid_->setColorParent(rb, ra, pa ^ pb ^ parity);
+    grid_->setColorSize(ra, grid_->getColorSize(ra) + grid_->getColorSize(rb));
+    return true;
+}
+
+/* Queues the numbers, points and edges around every cell of a set */
+void CellColoring::touchSet(int root) {
+    int c = root;
+    do {
+        if (c != outside_) {
+            touchCell(c / n_, c % n_);
+        } else {
+            for (int j = 0; j < n_; j++) {
+                queueNumber(0, j);
+                queueNumber(m_-1, j);
+                edges_.push_back(EdgeAssignment { Coordinates { 0, j }, EMPTY, true });
+                edges_.push_back(EdgeAssignment { Coordinates { m_, j }, EMPTY, true });
+            }
+            for (int i = 0; i < m_; i++) {
+                queueNumber(i, 0);
+                queueNumber(i, n_-1);
+                edges_.push_back(EdgeAssignment { Coordinates { i, 0 }, EMPTY, false });
+                edges_.push_back(EdgeAssignment { Coordinates { i, n_ }, EMPTY, false });
+            }
+            for (int j = 0; j < n_+1; j++) {
+                queuePoint(0, j);
+                queuePoint(m_, j);
+            }
+            for (int i = 0; i < m_+1; i++) {
+                queuePoint(i, 0);
+                queuePoint(i, n_);
+            }
+        }
+        c = grid_->getColorNext(c);
+    } while (c != root);
+}
+
+/* Queues the numbers and points that a cell is part of, and its edges */
+void CellColoring::touchCell(int i, int j) {
+    queueNumber(i, j);
+    queueNumber(i-1, j);
+    queueNumber(i+1, j);
+    queueNumber(i, j-1);
+    queueNumber(i, j+1);
+    queuePoint(i, j);
+    queuePoint(i, j+1);
+    queuePoint(i+1, j);
+    queuePoint(i+1, j+1);
+    edges_.push_back(EdgeAssignment { Coordinates { i, j }, EMPTY, true });
+    edges_.push_back(EdgeAssignment { Coordinates { i+1, j }, EMPTY, true });
+    edges_.push_back(EdgeAssignment { Coordinates { i, j }, EMPTY, false });
+    edges_.push_back(EdgeAssignment { Coordinates { i, j+1 }, EMPTY, false });
+}
+
+/* Queues the number of a cell to be settled, if it has one */
+void CellColoring::queueNumber(int i, int j) {
+    if (i < 0 || i >= m_ || j < 0 || j >= n_ || grid_->getNumber(i, j) == NONE) {
+        return;
+    }
+    int c = i*n_ + j;
+    if (!numberQueued_[c]) {
+        numberQueued_[c] = true;
+        numbers_.push_back(c);
+    }
+}
+
+/* Queues a point to be settled */
+void CellColoring::queuePoint(int i, int j) {
+    int p = i*(n_+1) + j;
+    if (!pointQueued_[p]) {
+        pointQueued_[p] = true;
+        points_.push_back(p);
+    }
+}
+
+/* Tries every way of coloring the sets of a few cells, keeping those
+ * in which the count of the given pairs of cells that differ is one of
+ * the allowed counts, given as a mask. Sets of two of the cells that
+ * are alike in all of them, or different in all of them, are joined.
+ * Nothing is learned from cells that are all in one set, nor from
+ * cells in sets of their own, which the rules already see to. Gives
+ * false if no way is left. */
+bool CellColoring::settle(int const cells[], int size, int const pairs[4][2], unsigned allowed) {
+    int roots[5];
+    int parities[5];
+    int sets[5];
+    int count = 0;
+    for (int k = 0; k < size; k++) {
+        int root = findRoot(cells[k], parities[k]);
+        sets[k] = 0;
+        while (sets[k] < count && roots[sets[k]] != root) {
+            sets[k]++;
+        }
+        if (sets[k] == count) {
+            roots[count++] = root;
+        }
+    }
+    if (count == 1 || count == size) {
+        return true;
+    }
+
+    /* the first set is taken to be alike to the outside, since only
+     * how the sets compare to each other matters */
+    unsigned kept[16];
+    int ways = 0;
+    for (unsigned colors = 0; colors < (1u << count); colors += 2) {
+        int differ = 0;
+        for (int p = 0; p < 4; p++) {
+            int a = pairs[p][0];
+            int b = pairs[p][1];
+            differ += ((colors >> sets[a]) ^ parities[a] ^ (colors >> sets[b]) ^ parities[b]) & 1;
+        }
+        if ((allowed >> differ) & 1) {
+            kept[ways++] = colors;
+        }
+    }
+    if (ways == 0) {
+        return false;
+    }
+
+    for (int x = 0; x < count; x++) {
+        for (int y = x+1; y < count; y++) {
+            int parity = ((kept[0] >> x) ^ (kept[0] >> y)) & 1;
+            bool forced = true;
+            for (int w = 1; w < ways && forced; w++) {
+                forced = (((kept[w] >> x) ^ (kept[w] >> y)) & 1) == parity;
+            }
+            if (forced && !join(roots[x], roots[y], parity)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/* Settles the cells around a number */
+bool CellColoring::settleNumber(int i, int j) {
+    int cells[5] = { cellOf(i, j), cellOf(i-1, j), cellOf(i+1, j), cellOf(i, j-1), cellOf(i, j+1) };
+    return settle(cells, 5, AROUND_NUMBER, 1u << (grid_->getNumber(i, j) - ZERO));
+}
+
+/* Settles the cells around a point */
+bool CellColoring::settlePoint(int i, int j) {
+    int cells[4] = { cellOf(i-1, j-1), cellOf(i-1, j), cellOf(i, j), cellOf(i, j-1) };
+    return settle(cells, 4, AROUND_POINT, (1u << 0) | (1u << 2));
+}
+
+/* Sets each queued edge that is still empty and whose cells are in
+ * the same set, a line if they differ and not one if they are alike.
+ * Gives whether any edge was set. */
+bool CellColoring::setEdges() {
+    bool changed = false;
+    for (int k = 0; k < edges_.size() && grid_->getValid(); k++) {
+        int i = edges_[k].coords.i;
+        int j = edges_[k].coords.j;
+        int pa;
+        int pb;
+        if (edges_[k].h) {
+            if (grid_->getHLine(i, j) == EMPTY && findRoot(cellOf(i-1, j), pa) == findRoot(cellOf(i, j), pb)) {
+                grid_->setHLine(i, j, pa != pb ? LINE : NLINE);
+                changed = true;
+            }
+        } else if (grid_->getVLine(i, j) == EMPTY && findRoot(cellOf(i, j-1), pa) == findRoot(cellOf(i, j), pb)) {
+            grid_->setVLine(i, j, pa != pb ? LINE : NLINE);
+            changed = true;
+        }
+    }
+    edges_.clear();
+    if (changed) {
+        grid_->setUpdated(true);
+    }
+    return changed;
+}
+
+/* Empties the queues, for when the grid has been found to clash */
+void CellColoring::clearQueues() {
+    for (int k = 0; k < numbers_.size(); k++) {
+        numberQueued_[numbers_[k]] = false;
+    }
+    for (int k = 0; k < points_.size(); k++) {
+        pointQueued_[points_[k]] = false;
+    }
+    numbers_.clear();
+    points_.clear();
+    edges_.clear();
+}
@@ -0,0 +1,56 @@
+#ifndef CELLCOLORING_H
+#define CELLCOLORING_H
+#include <vector>
+#include "../shared/grid.h"
+#include "../shared/structs.h"
+
+/* The cells of a grid, each inside or outside the loop, as far as the
+ * edges set so far relate them. An edge is a line exactly when the
+ * cells on either side of it differ, so every edge that is set puts
+ * its two cells in the same set, with the parity of each cell against
+ * the one standing for the set telling whether they are alike. Off
+ * the lattice is a cell of its own that is outside.
+ * Each number asks for that many of its cell and the four around it
+ * to differ, and each point for none or two of the four cells around
+ * it to differ from the next; where two of those cells are alike or
+ * different in every way of coloring the sets they are in that keeps
+ * to that, their sets are joined. Any edge whose two cells end up in
+ * the same set is then known, however far apart the edges that
+ * joined them are.
+ * The sets live in the grid, which records every join on its trail,
+ * so rolling a guess back undoes the joins it made. Each call joins
+ * the cells of the edges set since the last one. Only the numbers and
+ * points around the cells of the smaller of two sets being joined can
+ * learn anything from the join, and only the edges of those cells can
+ * be decided by it, so only they are looked at again. */
+class CellColoring {
+    public:
+        bool propagate(Grid & grid);
+
+    private:
+        void resize();
+        int cellOf(int i, int j) const;
+        int findRoot(int c, int & parity) const;
+        bool join(int a, int b, int parity);
+        void touchSet(int root);
+        void touchCell(int i, int j);
+        void queueNumber(int i, int j);
+        void queuePoint(int i, int j);
+        bool settle(int const cells[], int size, int const pairs[4][2], unsigned allowed);
+        bool settleNumber(int i, int j);
+        bool settlePoint(int i, int j);
+        bool setEdges();
+        void clearQueues();
+
+        Grid * grid_;
+        int m_ = 0;
+        int n_ = 0;
+        int outside_;       /* the cell standing for everything off the lattice */
+        std::vector<int> numbers_;      /* cells whose number may have something to settle */
+        std::vector<int> points_;       /* points that may have something to settle */
+        std::vector<char> numberQueued_;
+        std::vector<char> pointQueued_;
+        std::vector<EdgeAssignment> edges_;     /* edges whose two cells may have been joined */
+};
+
+#endif
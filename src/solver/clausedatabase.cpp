@@ -0,0 +1,113 @@
+#include "clausedatabase.h"
+#include <algorithm>
+#include <stdint.h>
+#include <unordered_set>
+#include <vector>
+#include "../shared/enums.h"
+#include "../shared/grid.h"
+#include "../shared/structs.h"
+
+#define MAX_CLAUSES 65536
+
+/* Takes the grid whose edges the nogoods will be about */
+ClauseDatabase::ClauseDatabase(Grid const & grid) {
+    m_ = grid.getHeight();
+    stride_ = grid.getStride();
+    edges_ = grid.getEdgeCount();
+    starts_.push_back(0);
+    occurrences_.resize(getLiterals());
+    facts_.assign(getLiterals(), false);
+    generation_ = 0;
+}
+
+/* Forgets every nogood and fact, for a grid of the same size, keeping
+ * the memory they took to be filled again */
+void ClauseDatabase::clear() {
+    literals_.clear();
+    starts_.assign(1, 0);
+    for (int l = 0; l < occurrences_.size(); l++) {
+        occurrences_[l].clear();
+    }
+    known_.clear();
+    facts_.assign(getLiterals(), false);
+    generation_ = 0;
+}
+
+/* Gives the literal for an edge having a given value, which is LINE
+ * or NLINE. The edge comes from the index the grid gives it. */
+int ClauseDatabase::literalOf(int i, int j, bool hline, Edge edge) const {
+    int k = (hline ? 0 : (m_+1)*stride_) + i*stride_ + j;
+    return 2*k + (edge == NLINE);
+}
+
+/* Gives the edge and value of a literal */
+EdgeAssignment ClauseDatabase::edgeOf(int literal) const {
+    int k = literal / 2;
+    bool hline = k < (m_+1)*stride_;
+    if (!hline) {
+        k -= (m_+1)*stride_;
+    }
+    return EdgeAssignment { Coordinates { k / stride_, k % stride_ }, (literal % 2) ? NLINE : LINE, hline };
+}
+
+/* Checks whether the edge of a literal has the literal's value */
+bool ClauseDatabase::holds(Grid const & grid, int literal) const {
+    EdgeAssignment a = edgeOf(literal);
+    Edge edge = a.h ? grid.getHLine(a.coords.i, a.coords.j) : grid.getVLine(a.coords.i, a.coords.j);
+    return edge == a.edge;
+}
+
+/* Adds a nogood unless it is already known or the database is full,
+ * giving whether it was added. Its literals are kept sorted, so the
+ * same nogood learned twice is recognized whatever order it was
+ * learned in. */
+bool ClauseDatabase::add(Nogood const & nogood) {
+    if (size() >= MAX_CLAUSES) {
+        return false;
+    }
+
+    Nogood sorted = nogood;
+    std::sort(sorted.begin(), sorted.end());
+    uint64_t hash = sorted.size();
+    for (int k = 0; k < sorted.size(); k++) {
+        hash = (hash ^ (uint64_t)sorted[k]) * 0x9e3779b97f4a7c15ULL;
+        hash ^= hash >> 29;
+    }
+    if (!known_.insert(hash).second) {
+        return false;
+    }
+
+    int c = size();
+    generation_++;
+    literals_.insert(literals_.end(), sorted.begin(), sorted.end());
+    starts_.push_back(literals_.size());
+    for (int k = 0; k < sorted.size(); k++) {
+        occurrences_[sorted[k]].push_back(c);
+    }
+    return true;
+}
+
+/* Takes the edges set on a grid as the facts, which only ever grow */
+void ClauseDatabase::setFacts(Grid const & grid) {
+    bool changed = false;
+    for (int i = 0; i < grid.getHeight()+1; i++) {
+        for (int j = 0; j < grid.getWidth()+1; j++) {
+            if (j < grid.getWidth() && grid.getHLine(i, j) != EMPTY) {
+                changed = addFact(literalOf(i, j, true, grid.getHLine(i, j))) || changed;
+            }
+            if (i < grid.getHeight() && grid.getVLine(i, j) != EMPTY) {
+                changed = addFact(literalOf(i, j, false, grid.getVLine(i, j))) || changed;
+            }
+        }
+    }
+    generation_ += changed;
+}
+
+/* Marks a literal as a fact, giving whether it was not one already */
+bool ClauseDatabase::addFact(int literal) {
+    if (facts_[literal]) {
+        return false;
+    }
+    facts_[literal] = true;
+    return true;
+}
@@ -0,0 +1,60 @@
+#ifndef CLAUSEDATABASE_H
+#define CLAUSEDATABASE_H
+#include <stdint.h>
+#include <unordered_set>
+#include <vector>
+#include "../shared/enums.h"
+#include "../shared/grid.h"
+#include "../shared/structs.h"
+
+/* Values of edges that no solution has all of at once, learned from a
+ * guess that ended in a contradiction. Each literal is an edge along
+ * with one of its values, as given by ClauseDatabase::literalOf. */
+typedef std::vector<int> Nogood;
+
+/* The nogoods known to a tree of solvers. Nogoods are only ever
+ * added, and only while no solver is reading them, so the index of a
+ * nogood never changes and every solver sees the same ones for as
+ * long as it runs. Each literal keeps a list of the nogoods that have
+ * it, for finding the ones that an edge being set might break. An
+ * edge that a nogood forced is marked on the grid with causeOf the
+ * nogood, which keeps clear of NO_CAUSE and of the causes of rules.
+ * The edges of the grid of the solver that started the tree are kept
+ * as facts, which hold in every solution and so need not be part of
+ * any nogood. The generation counts the times that the nogoods or
+ * the facts have changed. */
+class ClauseDatabase {
+    public:
+        ClauseDatabase(Grid const & grid);
+        void clear();
+        int literalOf(int i, int j, bool hline, Edge edge) const;
+        int literalOf(EdgeAssignment const & a) const { return literalOf(a.coords.i, a.coords.j, a.h, a.edge); };
+        EdgeAssignment edgeOf(int literal) const;
+        bool holds(Grid const & grid, int literal) const;
+        bool add(Nogood const & nogood);
+        void setFacts(Grid const & grid);
+        bool isFact(int literal) const { return facts_[literal]; };
+        int getGeneration() const { return generation_; };
+        int size() const { return starts_.size() - 1; };
+        int getLiterals() const { return 2 * edges_; };
+        int const * begin(int c) const { return literals_.data() + starts_[c]; };
+        int const * end(int c) const { return literals_.data() + starts_[c+1]; };
+        std::vector<int> const & getOccurrences(int literal) const { return occurrences_[literal]; };
+        static int causeOf(int c) { return -2 - c; };
+        static int nogoodOf(int cause) { return -2 - cause; };
+
+    private:
+        bool addFact(int literal);
+
+        int m_;
+        int stride_;
+        int edges_;
+        std::vector<int> literals_;     /* every nogood, one after the other */
+        std::vector<int> starts_;       /* where each nogood starts in literals_, and where the last one ends */
+        std::vector<std::vector<int> > occurrences_;
+        std::unordered_set<uint64_t> known_;    /* hashes of the nogoods already added */
+        std::vector<char> facts_;       /* whether each literal holds on the grid of the root solver */
+        int generation_;
+};
+
+#endif
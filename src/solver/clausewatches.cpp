@@ -0,0 +1,200 @@
+#include "clausewatches.h"
+#include <algorithm>
+#include <vector>
+#include "clausedatabase.h"
+#include "../shared/constants.h"
+#include "../shared/enums.h"
+#include "../shared/grid.h"
+#include "../shared/structs.h"
+
+/* How far a literal is from being a good one to watch: one whose edge
+ * is not set or set the other way, one that has come to hold but has
+ * not been looked at yet, or one that holds and has been */
+enum WatchRank { OPEN, PENDING, SPENT };
+
+ClauseWatches::ClauseWatches(ClauseDatabase const & clauses) {
+    clauses_ = &clauses;
+    conflict_ = false;
+    reset();
+}
+
+/* Forgets every watch */
+void ClauseWatches::reset() {
+    watched_ = 0;
+    watches_.clear();
+    lists_.clear();
+}
+
+/* Applies the nogoods to the edges set since the last call, setting
+ * each edge that a nogood forces and failing the grid if one is
+ * broken. Nogoods added to the database since are watched first, all
+ * of them again if the grid has been filled in from scratch. Gives
+ * whether any edge was set. */
+bool ClauseWatches::propagate(Grid & grid) {
+    if (grid.getFullSweep(CLAUSE_QUEUE)) {
+        reset();
+        grid.setFullSweep(CLAUSE_QUEUE, false);
+        grid.discardChanges(CLAUSE_QUEUE);
+    }
+    if (clauses_->size() == 0) {
+        grid.discardChanges(CLAUSE_QUEUE);
+        return false;
+    }
+
+    bool changed = false;
+    if (watched_ < clauses_->size()) {
+        watchNew(grid);
+        changed = force(grid);
+    }
+
+    while (grid.hasChanges(CLAUSE_QUEUE) && grid.getValid()) {
+        EdgeAssignment change = grid.popChange(CLAUSE_QUEUE);
+        visit(grid, clauses_->literalOf(change));
+        changed = force(grid) || changed;
+    }
+
+    return changed;
+}
+
+/* Watches the nogoods added to the database since the last call */
+void ClauseWatches::watchNew(Grid & grid) {
+    if (lists_.empty()) {
+        lists_.resize(clauses_->getLiterals());
+    }
+
+    std::vector<EdgeAssignment> changes;
+    grid.getPendingChanges(CLAUSE_QUEUE, changes);
+    std::vector<int> pending;
+    for (int k = 0; k < changes.size(); k++) {
+        pending.push_back(clauses_->literalOf(changes[k]));
+    }
+    std::sort(pending.begin(), pending.end());
+
+    watches_.resize(2 * clauses_->size());
+    for (; watched_ < clauses_->size(); watched_++) {
+        watch(grid, watched_, pending);
+    }
+}
+
+/* Picks the two literals of a nogood to watch, given the literals
+ * that have come to hold without being looked at. Where all but one
+ * of its literals already hold, the nogood is found to force an edge
+ * or be broken right away, unless one of them is still to be looked
+ * at, which will find it then. */
+void ClauseWatches::watch(Grid & grid, int c, std::vector<int> const & pending) {
+    int best[2] = { -1, -1 };
+    WatchRank ranks[2] = { SPENT, SPENT };
+    for (int const * l = clauses_->begin(c); l != clauses_->end(c); l++) {
+        WatchRank rank = OPEN;
+        if (clauses_->holds(grid, *l)) {
+            rank = std::binary_search(pending.begin(), pending.end(), *l) ? PENDING : SPENT;
+        }
+
+        if (best[0] == -1 || rank < ranks[0]) {
+            best[1] = best[0];
+            ranks[1] = ranks[0];
+            best[0] = *l;
+            ranks[0] = rank;
+        } else if (best[1] == -1 || rank < ranks[1]) {
+            best[1] = *l;
+            ranks[1] = rank;
+        }
+    }
+
+    watches_[2*c] = best[0];
+    watches_[2*c + 1] = best[1];
+    lists_[best[0]].push_back(c);
+    lists_[best[1]].push_back(c);
+
+    if (ranks[0] == SPENT) {
+        conflict_ = true;
+    } else if (ranks[0] == OPEN && ranks[1] == SPENT) {
+        units_.push_back(c);
+    }
+}
+
+/* Moves the watch of every nogood watching a literal that has come
+ * to hold to a literal that does not, noting the nogoods that have
+ * none left */
+void ClauseWatches::visit(Grid & grid, int literal) {
+    std::vector<int> & list = lists_[literal];
+    int keep = 0;
+    for (int k = 0; k < list.size(); k++) {
+        int c = list[k];
+        int * w = &watches_[2*c];
+        if (w[0] != literal) {
+            std::swap(w[0], w[1]);
+        }
+
+        int replacement = -1;
+        bool satisfied = false;
+        EdgeAssignment other = clauses_->edgeOf(w[1]);
+        Edge edge = other.h ? grid.getHLine(other.coords.i, other.coords.j) : grid.getVLine(other.coords.i, other.coords.j);
+        if (edge != EMPTY && edge != other.edge) {
+            satisfied = true;
+        }
+        for (int const * l = clauses_->begin(c); !satisfied && l != clauses_->end(c); l++) {
+            if (*l != w[0] && *l != w[1] && !clauses_->holds(grid, *l)) {
+                replacement = *l;
+                break;
+            }
+        }
+
+        if (replacement != -1) {
+            w[0] = replacement;
+            lists_[replacement].push_back(c);
+            continue;
+        }
+
+        list[keep++] = c;
+        if (satisfied) {
+            continue;
+        } else if (edge == EMPTY) {
+            units_.push_back(c);
+        } else {
+            conflict_ = true;
+        }
+    }
+    list.resize(keep);
+}
+
+/* Sets the edge that each nogood found to force one forces, in the
+ * order the nogoods were learned, or fails the grid if one was found
+ * to be broken. Gives whether any edge was set. */
+bool ClauseWatches::force(Grid & grid) {
+    if (conflict_) {
+        conflict_ = false;
+        units_.clear();
+        grid.setValid(false);
+        return false;
+    }
+
+    bool changed = false;
+    std::sort(units_.begin(), units_.end());
+    for (int k = 0; k < units_.size(); k++) {
+        int c = units_[k];
+        int l = clauses_->holds(grid, watches_[2*c]) ? watches_[2*c + 1] : watches_[2*c];
+        EdgeAssignment a = clauses_->edgeOf(l);
+        Edge edge = a.h ? grid.getHLine(a.coords.i, a.coords.j) : grid.getVLine(a.coords.i, a.coords.j);
+        if (edge == a.edge) {
+            grid.setValid(false);
+            break;
+        } else if (edge != EMPTY) {
+            continue;
+        }
+
+        Edge forced = (a.edge == LINE) ? NLINE : LINE;
+        grid.setCause(ClauseDatabase::causeOf(c));
+        if (a.h) {
+            grid.setHLine(a.coords.i, a.coords.j, forced);
+        } else {
+            grid.setVLine(a.coords.i, a.coords.j, forced);
+        }
+        grid.setCause(NO_CAUSE);
+        grid.setUpdated(true);
+        changed = true;
+    }
+    units_.clear();
+
+    return changed;
+}
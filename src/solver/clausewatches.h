@@ -0,0 +1,40 @@
+#ifndef CLAUSEWATCHES_H
+#define CLAUSEWATCHES_H
+#include <vector>
+#include "clausedatabase.h"
+#include "../shared/grid.h"
+
+/* Two literals of each nogood being watched on one grid. A nogood
+ * can only be broken, or force an edge, once all but one of its
+ * literals hold, so it only needs looking at when one of two literals
+ * that did not hold comes to hold. A watch only ever moves to a
+ * literal that does not hold, so rolling edges back off the grid
+ * never leaves a watch where it should not be, and a guess can be
+ * rolled back without touching the watches. Solvers that take turns
+ * on the same grid share its watches, while a solver on a scratch
+ * grid watches it itself.
+ * Which watches a nogood has depends on every edge that has been
+ * set and rolled back before, but which nogoods are forced by an edge
+ * being set does not, so they are applied in the order they were
+ * learned to set the same edges in the same order either way. */
+class ClauseWatches {
+    public:
+        ClauseWatches(ClauseDatabase const & clauses);
+        bool propagate(Grid & grid);
+        void reset();
+
+    private:
+        void watchNew(Grid & grid);
+        void watch(Grid & grid, int c, std::vector<int> const & pending);
+        void visit(Grid & grid, int literal);
+        bool force(Grid & grid);
+
+        ClauseDatabase const * clauses_;
+        int watched_;       /* nogoods of the database watched so far */
+        std::vector<int> watches_;      /* the two literals watched in each nogood */
+        std::vector<std::vector<int> > lists_;  /* nogoods watching each literal */
+        std::vector<int> units_;        /* nogoods found to force an edge */
+        bool conflict_;     /* a nogood was found to be broken */
+};
+
+#endif
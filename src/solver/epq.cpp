@@ -1,24 +1,31 @@
 #include "epq.h"
+#include <atomic>
 #include <cassert>
-#include <queue>
+#include <cstring>
+#include <memory>
+#include <stdint.h>
+#include <vector>
 #include "../shared/structs.h"
 
+#define ACTIVITY_DECAY 0.95    /* how much less each reward counts than the next */
+
 void EPQ::initEPQ(int m, int n)  {
     assert(m > 0 && n > 0);
 
     m_ = m;
     n_ = n;
+    heap_.reset();
 
     for (int i = 1; i < m-1; i++) {
         for (int j = 1; j < n-1; j++) {
-            pq_.push(createPrioEdge(0, i, j, true));
-            pq_.push(createPrioEdge(0, i, j, false));
+            push(createPrioEdge(0, i, j, true));
+            push(createPrioEdge(0, i, j, false));
         }
-        pq_.push(createPrioEdge(0, i, n-1, false));
+        push(createPrioEdge(0, i, n-1, false));
     }
 
     for (int j = 1; j < n-1; j++) {
-        pq_.push(createPrioEdge(0, m-1, j, true));
+        push(createPrioEdge(0, m-1, j, true));
     }
 }
 
@@ -29,54 +36,266 @@ PrioEdge EPQ::createPrioEdge(double prio, int i, int j, bool hLine) {
 }
 
 bool EPQ::empty() const {
-    return pq_.empty();
+    return !heap_ || heap_->entries.empty();
 }
 
 int EPQ::size() const {
-    return pq_.size();
+    return heap_ ? heap_->entries.size() : 0;
 }
 
 PrioEdge EPQ::top() const {
-    return pq_.top();
+    assert(!empty());
+
+    return heap_->entries[0];
 }
 
+/* Queues an edge, or moves it to its new priority if it is queued */
 void EPQ::push(PrioEdge pe) {
-    pq_.push(pe);
+    Heap & heap = own();
+    int k = heap.positions[keyOf(pe)];
+    if (k == -1) {
+        heap.entries.push_back(pe);
+        place(heap, heap.entries.size() - 1, pe);
+        siftUp(heap, heap.entries.size() - 1);
+        return;
+    }
+
+    PrioEdge old = heap.entries[k];
+    heap.entries[k] = pe;
+    if (before(pe, old)) {
+        siftUp(heap, k);
+    } else {
+        siftDown(heap, k);
+    }
 }
 
 void EPQ::pop() {
-    pq_.pop();
+    assert(!empty());
+
+    Heap & heap = own();
+    heap.positions[keyOf(heap.entries[0])] = -1;
+    PrioEdge last = heap.entries.back();
+    heap.entries.pop_back();
+    if (!heap.entries.empty()) {
+        place(heap, 0, last);
+        siftDown(heap, 0);
+    }
 }
 
 void EPQ::emplace(double prio, int i, int j, bool hLine) {
-    pq_.push(createPrioEdge(prio, i, j, hLine));
+    push(createPrioEdge(prio, i, j, hLine));
 }
 
 std::vector<PrioEdge> EPQ::copyPQToVector() const {
-    std::priority_queue<PrioEdge, std::vector<PrioEdge>, ComparePrioEdge> newPQ;
-    std::vector<PrioEdge> outputvec(pq_.size());
-    std::copy(&(pq_.top()), &(pq_.top()) + pq_.size(), &outputvec[0]);
-    return outputvec;
+    if (!heap_) {
+        return std::vector<PrioEdge>();
+    }
+    return heap_->entries;
 }
 
-void EPQ::copyPQ(EPQ orig) {
+/* Adds the edges of another queue, sharing its heap if this queue
+ * has none yet */
+void EPQ::copyPQ(EPQ const & orig) {
+    if (empty()) {
+        m_ = orig.m_;
+        n_ = orig.n_;
+        heap_ = orig.heap_;
+        return;
+    }
+
     std::vector<PrioEdge> prioEdgeVec = orig.copyPQToVector();
     for (int i = 0; i < prioEdgeVec.size(); i++) {
-        pq_.push(prioEdgeVec[i]);
+        push(prioEdgeVec[i]);
+    }
+}
+
+/* Empties the queue, keeping its heap to copy into later if no other
+ * queue shares it */
+void EPQ::clear() {
+    if (heap_ && heap_.use_count() == 1) {
+        spare_.swap(heap_);
     }
+    heap_.reset();
 }
 
-void EPQ::copySubsetPQ(EPQ orig) {
+void EPQ::copySubsetPQ(EPQ const & orig) {
+    if (empty()) {
+        m_ = orig.m_;
+        n_ = orig.n_;
+    }
+
     PrioEdge pe = orig.top();
     std::vector<PrioEdge> prioEdgeVec = orig.copyPQToVector();
     for (int i = 0; i < prioEdgeVec.size(); i++) {
         PrioEdge cur = prioEdgeVec[i];
         if (cur.coords.i < pe.coords.i && cur.coords.j < pe.coords.j)
-            pq_.push(prioEdgeVec[i]);
+            push(prioEdgeVec[i]);
     }
 }
 
+/* Lowers an edge for a guess that learned nothing */
+void EPQ::lower(PrioEdge pe) {
+    own().misses[keyOf(pe)]++;
+    pe.priority = pe.priority - 1;
+    push(pe);
+}
 
+/* Gives an edge the priority a heuristic scores it at, less the
+ * times it has been lowered */
+void EPQ::rescore(PrioEdge pe, double score) {
+    pe.priority = score - own().misses[keyOf(pe)];
+    push(pe);
+}
 
+/* Raises the activity of an edge whose guess learned something, and
+ * of the edges that touch it, which are likely to learn something
+ * too. The activities are scaled down together before they grow too
+ * large. */
+void EPQ::reward(PrioEdge const & pe) {
+    Heap & heap = own();
+    int i = pe.coords.i;
+    int j = pe.coords.j;
+    PrioEdge around[7] = { pe };
+    if (pe.h) {
+        around[1] = createNeighbor(i, j-1, true);
+        around[2] = createNeighbor(i, j+1, true);
+        around[3] = createNeighbor(i-1, j, false);
+        around[4] = createNeighbor(i, j, false);
+        around[5] = createNeighbor(i-1, j+1, false);
+        around[6] = createNeighbor(i, j+1, false);
+    } else {
+        around[1] = createNeighbor(i-1, j, false);
+        around[2] = createNeighbor(i+1, j, false);
+        around[3] = createNeighbor(i, j-1, true);
+        around[4] = createNeighbor(i, j, true);
+        around[5] = createNeighbor(i+1, j-1, true);
+        around[6] = createNeighbor(i+1, j, true);
+    }
+    for (int k = 0; k < 7; k++) {
+        if (around[k].coords.i != -1) {
+            heap.activities[keyOf(around[k])] += heap.increment;
+        }
+    }
+    heap.increment /= ACTIVITY_DECAY;
+    if (heap.increment > 1e100) {
+        for (int k = 0; k < heap.activities.size(); k++) {
+            heap.activities[k] *= 1e-100;
+        }
+        heap.increment *= 1e-100;
+    }
+}
 
+/* Gives an edge next to another, or one at -1, -1 if it is off the
+ * lattice */
+PrioEdge EPQ::createNeighbor(int i, int j, bool hLine) const {
+    if (i < 0 || j < 0 || i >= m_ + hLine || j >= n_ + !hLine) {
+        return PrioEdge { Coordinates { -1, -1 }, 0, hLine };
+    }
+    return PrioEdge { Coordinates { i, j }, 0, hLine };
+}
 
+double EPQ::getActivity(PrioEdge const & pe) const {
+    return heap_ ? heap_->activities[keyOf(pe)] : 0;
+}
+
+/* Hashes the edges of the queue along with their priorities, which
+ * alone decide the order the queue gives them back in, so the way
+ * they happen to be laid out in the heap does not matter. What a
+ * heuristic would rank them by is hashed as well; the activities stay
+ * at 0 unless the heuristic uses them, so only then do they tell two
+ * queues apart. */
+uint64_t EPQ::hash() const {
+    uint64_t h = size();
+    if (empty()) {
+        return h;
+    }
+
+    std::vector<PrioEdge> const & entries = heap_->entries;
+    for (int k = 0; k < entries.size(); k++) {
+        uint64_t x = ((uint64_t)entries[k].coords.i << 32) ^ ((uint64_t)entries[k].coords.j << 1) ^ entries[k].h;
+        x ^= bitsOf(entries[k].priority) * 0xff51afd7ed558ccdULL;
+        x ^= (uint64_t)heap_->misses[keyOf(entries[k])] << 20;
+        x ^= bitsOf(heap_->activities[keyOf(entries[k])]) * 0xc2b2ae3d27d4eb4fULL;
+        x *= 0x9e3779b97f4a7c15ULL;
+        h += x ^ (x >> 29);
+    }
+    return h;
+}
+
+/* Gives the bits of a double, which tell every value apart however
+ * large it grows, where converting it to an integer would overflow.
+ * Adding zero turns -0 into 0, which it compares equal to. */
+uint64_t EPQ::bitsOf(double x) {
+    x += 0.0;
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return bits;
+}
+
+/* Tells whether one edge comes out of the queue before another */
+bool EPQ::before(PrioEdge const & a, PrioEdge const & b) const {
+    if (a.priority != b.priority) {
+        return a.priority > b.priority;
+    }
+    return keyOf(a) < keyOf(b);
+}
+
+/* Gives the heap for this queue to change, copying it first if it is
+ * shared with another queue, into the spare heap if there is one. A
+ * queue on another thread that let go of the heap or the spare last
+ * may still have been reading it, hence the fences. */
+EPQ::Heap & EPQ::own() {
+    if (!heap_) {
+        heap_ = std::make_shared<Heap>();
+        heap_->positions.assign(2 * (m_+1) * (n_+1), -1);
+        heap_->misses.assign(heap_->positions.size(), 0);
+        heap_->activities.assign(heap_->positions.size(), 0);
+        heap_->increment = 1;
+    } else if (heap_.use_count() > 1 && spare_ && spare_.use_count() == 1) {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        *spare_ = *heap_;
+        heap_.swap(spare_);
+        spare_.reset();
+    } else if (heap_.use_count() > 1) {
+        heap_ = std::make_shared<Heap>(*heap_);
+    } else {
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    return *heap_;
+}
+
+/* Puts an edge at a place in the heap */
+void EPQ::place(Heap & heap, int k, PrioEdge const & pe) {
+    heap.entries[k] = pe;
+    heap.positions[keyOf(pe)] = k;
+}
+
+/* Moves the edge at a place in the heap up past the edges it comes
+ * out before */
+void EPQ::siftUp(Heap & heap, int k) {
+    PrioEdge pe = heap.entries[k];
+    while (k > 0 && before(pe, heap.entries[(k-1) / 2])) {
+        place(heap, k, heap.entries[(k-1) / 2]);
+        k = (k-1) / 2;
+    }
+    place(heap, k, pe);
+}
+
+/* Moves the edge at a place in the heap down past the edges that
+ * come out before it */
+void EPQ::siftDown(Heap & heap, int k) {
+    PrioEdge pe = heap.entries[k];
+    int size = heap.entries.size();
+    while (2*k + 1 < size) {
+        int child = 2*k + 1;
+        if (child + 1 < size && before(heap.entries[child + 1], heap.entries[child])) {
+            child++;
+        }
+        if (!before(heap.entries[child], pe)) {
+            break;
+        }
+        place(heap, k, heap.entries[child]);
+        k = child;
+    }
+    place(heap, k, pe);
+}
@@ -1,17 +1,29 @@
 #ifndef EPQ_H
 #define EPQ_H
-#include <queue>
+#include <memory>
+#include <stdint.h>
 #include <vector>
 #include "../shared/structs.h"
 
+/* The edges to guess, highest priority first and, between edges of
+ * the same priority, in the order they lie on the grid. Each edge is
+ * in the queue at most once: pushing an edge that is already there
+ * moves it to its new priority in place. The heap is kept along with
+ * where each edge is in it, and is shared between copies of the queue
+ * until one of them changes it, so a solver spawned for a guess gets
+ * the queue of its parent without copying it unless it sweeps. A
+ * queue that is cleared keeps the heap it had to itself, and copies
+ * into it the next time it has to, rather than allocating one. Edges
+ * that have been set since they were queued are left in until they
+ * come to the top, where the sweep drops them.
+ * Each edge also has the number of times it was lowered for a guess
+ * that learned nothing, which stays with it when a heuristic ranks it
+ * again, and an activity that is raised each time a guess of it or of
+ * an edge touching it learns something, by an amount that grows each
+ * time so that the guesses of long ago count for less and less. */
 class EPQ {
-    class ComparePrioEdge {
-        public:
-            bool operator()(PrioEdge & e1, PrioEdge & e2) const { return e1.priority < e2.priority; };
-    };
-
     public:
-        EPQ() { };
+        EPQ() : m_(0), n_(0) { };
         void initEPQ(int m, int n);
         PrioEdge createPrioEdge(double prio, int i, int j, bool hLine);
 
@@ -22,13 +34,37 @@ class EPQ {
         void pop();
         void emplace(double prio, int i, int j, bool hLine);
         std::vector<PrioEdge> copyPQToVector() const;
-        void copyPQ(EPQ orig);
-        void copySubsetPQ(EPQ orig);
+        void copyPQ(EPQ const & orig);
+        void clear();
+        void copySubsetPQ(EPQ const & orig);
+        void lower(PrioEdge pe);
+        void rescore(PrioEdge pe, double score);
+        void reward(PrioEdge const & pe);
+        double getActivity(PrioEdge const & pe) const;
+        uint64_t hash() const;
 
     protected:
+        struct Heap {
+            std::vector<PrioEdge> entries;  /* a binary heap, the first entry on top */
+            std::vector<int> positions;     /* where each edge is in the heap, or -1 */
+            std::vector<int> misses;        /* times each edge was lowered */
+            std::vector<double> activities;
+            double increment;   /* what the next reward adds to an activity */
+        };
+
+        int keyOf(PrioEdge const & pe) const { return 2 * (pe.coords.i*(n_+1) + pe.coords.j) + !pe.h; };
+        bool before(PrioEdge const & a, PrioEdge const & b) const;
+        static uint64_t bitsOf(double x);
+        PrioEdge createNeighbor(int i, int j, bool hLine) const;
+        Heap & own();
+        void place(Heap & heap, int k, PrioEdge const & pe);
+        void siftUp(Heap & heap, int k);
+        void siftDown(Heap & heap, int k);
+
         int m_;
         int n_;
-        std::priority_queue<PrioEdge, std::vector<PrioEdge>, ComparePrioEdge> pq_;
+        std::shared_ptr<Heap> heap_;
+        std::shared_ptr<Heap> spare_;   /* a heap the queue had to itself before it was cleared, to copy into */
 };
 
 #endif
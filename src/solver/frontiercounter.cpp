@@ -0,0 +1,258 @@
+#include "frontiercounter.h"
+#include <algorithm>
+#include <cstring>
+#include <stdint.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "../shared/enums.h"
+#include "../shared/grid.h"
+#include "../shared/structs.h"
+
+#define MAX_FRONTIER_STATES 20000   /* frontiers at a step beyond which to give up */
+
+/* What a point of a frontier is */
+enum FrontierPoint { DEGREE_0, DEGREE_2, MATE };
+
+FrontierCounter::FrontierCounter(Grid const & grid, int limit) {
+    transposed_ = grid.getWidth() > grid.getHeight();
+    rows_ = transposed_ ? grid.getWidth() : grid.getHeight();
+    columns_ = transposed_ ? grid.getHeight() : grid.getWidth();
+    limit_ = limit;
+    complete_ = false;
+    count_ = 0;
+
+    if (columns_ > MAX_FRONTIER_WIDTH) {
+        return;
+    }
+    addSteps(grid);
+    count();
+}
+
+/* Gives the value of every edge of the k-th loop counted, for k below
+ * the count, by following the ways of getting to the frontier it ends
+ * at back to the start, skipping as many loops as come before it */
+void FrontierCounter::getSolution(int k, std::vector<EdgeAssignment> & loop) const {
+    int state = -1;
+    for (int e = 0; e < ends_.size() && state == -1; e++) {
+        if (k < counts_.back()[ends_[e]]) {
+            state = ends_[e];
+        } else {
+            k -= counts_.back()[ends_[e]];
+        }
+    }
+
+    loop.clear();
+    for (int t = steps_.size() - 1; t >= 0; t--) {
+        std::vector<Link> const & links = links_[t];
+        for (int l = 0; l < links.size(); l++) {
+            if (links[l].to != state) {
+                continue;
+            }
+            if (k < counts_[t][links[l].from]) {
+                EdgeAssignment edge = steps_[t].edge;
+                edge.edge = links[l].line ? LINE : NLINE;
+                loop.push_back(edge);
+                state = links[l].from;
+                break;
+            }
+            k -= counts_[t][links[l].from];
+        }
+    }
+}
+
+/* Lists the edges in the order they are decided in, a point at a time
+ * and for each point the edge to its right and then the one below it,
+ * along with the numbers of the cells */
+void FrontierCounter::addSteps(Grid const & grid) {
+    for (int i = 0; i < rows_+1; i++) {
+        for (int j = 0; j < columns_+1; j++) {
+            for (int h = 1; h >= 0; h--) {
+                if ((h && j == columns_) || (!h && i == rows_)) {
+                    continue;
+                }
+                Step step;
+                step.h = h;
+                step.i = i;
+                step.j = j;
+                step.last = !h || i == rows_;
+                step.edge.coords = transposed_ ? Coordinates { j, i } : Coordinates { i, j };
+                step.edge.edge = edgeAt(grid, h, i, j);
+                step.edge.h = transposed_ ? !h : h;
+                steps_.push_back(step);
+            }
+        }
+    }
+
+    for (int i = 0; i < rows_; i++) {
+        for (int j = 0; j < columns_; j++) {
+            numbers_.push_back(numberAt(grid, i, j));
+        }
+    }
+}
+
+/* Gives an edge of the grid as gone over */
+Edge FrontierCounter::edgeAt(Grid const & grid, bool h, int i, int j) const {
+    if (transposed_) {
+        return h ? grid.getVLine(j, i) : grid.getHLine(j, i);
+    }
+    return h ? grid.getHLine(i, j) : grid.getVLine(i, j);
+}
+
+/* Gives the lines a cell of the grid as gone over needs, or -1 */
+int FrontierCounter::numberAt(Grid const & grid, int i, int j) const {
+    Number number = transposed_ ? grid.getNumber(j, i) : grid.getNumber(i, j);
+    if (number == NONE) {
+        return -1;
+    }
+    return number - ZERO;
+}
+
+/* Decides the edges one at a time, merging the frontiers that are the
+ * same, and remembers the ways of getting to each */
+void FrontierCounter::count() {
+    Frontier start;
+    memset(&start, 0, sizeof(Frontier));
+    std::vector<Frontier> states(1, start);
+    std::vector<Frontier> next;
+    std::unordered_map<Frontier, int, FrontierHash> indices;
+    counts_.push_back(std::vector<int>(1, 1));
+
+    for (int t = 0; t < steps_.size(); t++) {
+        Step const & step = steps_[t];
+        std::vector<int> counts;
+        std::vector<Link> links;
+        next.clear();
+        indices.clear();
+        links.reserve(2 * states.size());
+
+        for (int s = 0; s < states.size(); s++) {
+            for (int line = 0; line < 2; line++) {
+                if (step.edge.edge == (line ? NLINE : LINE)) {
+                    continue;
+                }
+                Frontier state = states[s];
+                if (!take(state, step, line)) {
+                    continue;
+                }
+
+                std::pair<std::unordered_map<Frontier, int, FrontierHash>::iterator, bool> found = indices.insert(std::make_pair(state, (int)next.size()));
+                int to = found.first->second;
+                if (found.second) {
+                    next.push_back(state);
+                    counts.push_back(0);
+                }
+                counts[to] = std::min(counts[to] + counts_[t][s], limit_);
+                links.push_back(Link { s, to, line == 1 });
+            }
+        }
+
+        if (next.size() > MAX_FRONTIER_STATES) {
+            counts_.clear();
+            links_.clear();
+            return;
+        }
+        states.swap(next);
+        counts_.push_back(counts);
+        links_.push_back(links);
+    }
+
+    for (int s = 0; s < states.size(); s++) {
+        if (states[s].closed) {
+            ends_.push_back(s);
+            count_ = std::min(count_ + counts_.back()[s], limit_);
+        }
+    }
+    complete_ = true;
+}
+
+/* Decides an edge on a frontier, giving false if that leaves no loop
+ * to be found. Once the last edge of the point the frontier starts at
+ * is decided, the frontier moves on by a point. */
+bool FrontierCounter::take(Frontier & frontier, Step const & step, bool line) const {
+    int width = columns_ + 2;
+    if (line && (frontier.closed || !addLine(frontier, 0, step.h ? 1 : width - 1))) {
+        return false;
+    }
+
+    /* a horizontal edge is the last of the cell above it and the first
+     * of the one below, and a vertical one is between two cells whose
+     * top edges have been decided */
+    char * lines = frontier.lines;
+    if (step.h) {
+        if (step.i > 0) {
+            int number = numbers_[(step.i-1)*columns_ + step.j];
+            if (number != -1 && lines[step.j] + line != number) {
+                return false;
+            }
+        }
+        lines[step.j] = 0;
+    }
+    for (int c = step.j - !step.h; c <= step.j; c++) {
+        if (c < 0 || c == columns_ || step.i == rows_ || numbers_[step.i*columns_ + c] == -1) {
+            continue;
+        }
+        /* the edges of the cell still to be decided: three after its
+         * top one, two after its left one and one after its right one */
+        int rest = step.h ? 3 : (c == step.j ? 2 : 1);
+        lines[c] += line;
+        if (lines[c] > numbers_[step.i*columns_ + c] || lines[c] + rest < numbers_[step.i*columns_ + c]) {
+            return false;
+        }
+    }
+
+    if (step.last) {
+        char * points = frontier.points;
+        if (points[0] >= MATE) {
+            return false;
+        }
+        for (int k = 1; k < width; k++) {
+            points[k-1] = points[k] >= MATE ? points[k] - 1 : points[k];
+        }
+        points[width-1] = DEGREE_0;
+    }
+    return true;
+}
+
+/* Adds a line between two points of a frontier, giving false if
+ * either already has two or the line closes a loop while some other
+ * piece is still open */
+bool FrontierCounter::addLine(Frontier & frontier, int a, int b) const {
+    char * points = frontier.points;
+    if (points[a] == DEGREE_2 || points[b] == DEGREE_2) {
+        return false;
+    }
+
+    int x = points[a] >= MATE ? points[a] - MATE : a;
+    int y = points[b] >= MATE ? points[b] - MATE : b;
+    if (x == b) {
+        for (int k = 0; k < columns_ + 2; k++) {
+            if (k != a && k != b && points[k] >= MATE) {
+                return false;
+            }
+        }
+        frontier.closed = 1;
+    } else {
+        points[x] = MATE + y;
+        points[y] = MATE + x;
+    }
+    if (x != a) {
+        points[a] = DEGREE_2;
+    }
+    if (y != b) {
+        points[b] = DEGREE_2;
+    }
+    return true;
+}
+
+/* Hashes the bytes of a frontier, a word at a time */
+size_t FrontierCounter::FrontierHash::operator()(Frontier const & frontier) const {
+    uint64_t words[(sizeof(Frontier) + 7) / 8] = { 0 };
+    memcpy(words, &frontier, sizeof(Frontier));
+    uint64_t hash = 0;
+    for (int k = 0; k < sizeof(words) / 8; k++) {
+        hash = (hash ^ words[k]) * 0x9E3779B97F4A7C15ull;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
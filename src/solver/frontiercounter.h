@@ -0,0 +1,82 @@
+#ifndef FRONTIERCOUNTER_H
+#define FRONTIERCOUNTER_H
+#include <cstring>
+#include <vector>
+#include "../shared/grid.h"
+#include "../shared/structs.h"
+
+#define MAX_FRONTIER_WIDTH 12   /* cells across, border included, beyond which not to count */
+
+/* Counts the single loops that satisfy a grid by going over its edges
+ * a row of points at a time, each edge either a line or not. Only the
+ * points whose edges are not all decided yet, a frontier about as wide
+ * as the grid, can still be joined to, so it is enough to know which
+ * of them are ends of the same piece of line, along with how many
+ * lines the numbers that are being gone past have so far. Ways of
+ * getting to the same frontier are merged, so the cost grows with the
+ * height of the grid but only the width is in the exponent; a grid
+ * wider than it is high is gone over by columns instead.
+ * Counts are kept only up to a limit, and the ways of getting to each
+ * frontier are remembered, so that each loop counted can be given. */
+class FrontierCounter {
+    public:
+        FrontierCounter(Grid const & grid, int limit);
+        bool isComplete() const { return complete_; };
+        int getCount() const { return count_; };
+        void getSolution(int k, std::vector<EdgeAssignment> & loop) const;
+
+    private:
+        /* An edge, in the order it is decided in */
+        struct Step {
+            EdgeAssignment edge;    /* where it is on the grid */
+            bool h;                 /* horizontal when gone over by rows */
+            int i;
+            int j;
+            bool last;              /* the last edge of its point */
+        };
+
+        /* The points from the one whose edges are being decided on to a
+         * row of points ahead, each DEGREE_0 or DEGREE_2 for a point
+         * with that many lines, or for a point with one, MATE plus the
+         * place of the other end of its piece; the lines so far of the
+         * numbered cells being gone past, one for each column; and
+         * whether the loop has been closed */
+        struct Frontier {
+            char points[MAX_FRONTIER_WIDTH + 2];
+            char lines[MAX_FRONTIER_WIDTH];
+            char closed;
+            bool operator==(Frontier const & other) const { return memcmp(this, &other, sizeof(Frontier)) == 0; };
+        };
+
+        struct FrontierHash {
+            size_t operator()(Frontier const & frontier) const;
+        };
+
+        /* A way of getting to a frontier from one a step before */
+        struct Link {
+            int from;
+            int to;
+            bool line;
+        };
+
+        void addSteps(Grid const & grid);
+        void count();
+        Edge edgeAt(Grid const & grid, bool h, int i, int j) const;
+        int numberAt(Grid const & grid, int i, int j) const;
+        bool take(Frontier & frontier, Step const & step, bool line) const;
+        bool addLine(Frontier & frontier, int a, int b) const;
+
+        bool transposed_;   /* gone over by columns */
+        int rows_;
+        int columns_;
+        int limit_;
+        bool complete_;     /* the frontiers stayed few enough to count */
+        int count_;
+        std::vector<Step> steps_;
+        std::vector<int> numbers_;      /* lines each cell needs, or -1 */
+        std::vector<std::vector<int> > counts_;     /* loops leading to each frontier of each step */
+        std::vector<std::vector<Link> > links_;     /* into each step */
+        std::vector<int> ends_;         /* frontiers with the loop closed */
+};
+
+#endif
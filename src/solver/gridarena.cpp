@@ -0,0 +1,21 @@
+#include "gridarena.h"
+#include <memory>
+#include <vector>
+#include "../shared/grid.h"
+
+/* Gives a grid of the worker that nothing else is using */
+Grid * GridArena::acquire(int worker) {
+    if (free_[worker].empty()) {
+        owned_[worker].push_back(std::unique_ptr<Grid>(new Grid()));
+        return owned_[worker].back().get();
+    }
+
+    Grid * grid = free_[worker].back();
+    free_[worker].pop_back();
+    return grid;
+}
+
+/* Hands back a grid that the worker got from acquire() */
+void GridArena::release(int worker, Grid * grid) {
+    free_[worker].push_back(grid);
+}
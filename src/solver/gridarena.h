@@ -0,0 +1,24 @@
+#ifndef GRIDARENA_H
+#define GRIDARENA_H
+#include <memory>
+#include <vector>
+#include "../shared/grid.h"
+
+/* Scratch grids for guesses made away from the grid being solved,
+ * kept separately for each worker of a pool. A worker hands a grid
+ * back once it is done with it, to be reused by its later guesses,
+ * so grids are only allocated once and never shared between the
+ * caches of different cores. Only a worker itself may take grids
+ * from or give them back to its part of the arena. */
+class GridArena {
+    public:
+        GridArena(int workers) : owned_(workers), free_(workers) { };
+        Grid * acquire(int worker);
+        void release(int worker, Grid * grid);
+
+    private:
+        std::vector<std::vector<std::unique_ptr<Grid> > > owned_;
+        std::vector<std::vector<Grid *> > free_;
+};
+
+#endif
@@ -0,0 +1,27 @@
+#include "guessarena.h"
+#include <memory>
+#include <vector>
+#include "solver.h"
+#include "../shared/structs.h"
+
+/* Made and destroyed here, where the solvers they hold are known */
+GuessScratch::GuessScratch() { }
+
+GuessScratch::~GuessScratch() { }
+
+/* Gives scratch of the worker that no guess is using */
+GuessScratch * GuessArena::acquire(int worker) {
+    if (free_[worker].empty()) {
+        owned_[worker].push_back(std::unique_ptr<GuessScratch>(new GuessScratch()));
+        return owned_[worker].back().get();
+    }
+
+    GuessScratch * scratch = free_[worker].back();
+    free_[worker].pop_back();
+    return scratch;
+}
+
+/* Hands back scratch that the worker got from acquire() */
+void GuessArena::release(int worker, GuessScratch * scratch) {
+    free_[worker].push_back(scratch);
+}
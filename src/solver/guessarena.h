@@ -0,0 +1,45 @@
+#ifndef GUESSARENA_H
+#define GUESSARENA_H
+#include <memory>
+#include <vector>
+#include "../shared/structs.h"
+
+class Solver;
+
+/* What making one guess takes besides the grid: a solver for each
+ * value of the edge, the edges each value set, the points the LINE
+ * guess touched and the edges both values agree on. The solvers are
+ * started afresh for each guess rather than made again, and the lists
+ * are emptied rather than freed, so a guess allocates nothing once
+ * the scratch it is given has grown as far as it needs. */
+struct GuessScratch {
+    GuessScratch();
+    ~GuessScratch();
+
+    std::unique_ptr<Solver> lineSolver;
+    std::unique_ptr<Solver> nLineSolver;
+    std::vector<EdgeAssignment> lineDeductions;
+    std::vector<EdgeAssignment> nLineDeductions;
+    std::vector<EdgeAssignment> nLineAssignments;
+    std::vector<EdgeAssignment> common;
+    std::vector<Coordinates> lineTouched;
+};
+
+/* Scratch for the guesses of a tree of solvers, kept separately for
+ * each worker of a pool as the scratch grids are. A guess takes
+ * scratch when it starts and hands it back when it ends, so there is
+ * as much scratch as guesses are nested, and it is only allocated the
+ * first time they nest that far. Only a worker itself may take
+ * scratch from or give it back to its part of the arena. */
+class GuessArena {
+    public:
+        GuessArena(int workers) : owned_(workers), free_(workers) { };
+        GuessScratch * acquire(int worker);
+        void release(int worker, GuessScratch * scratch);
+
+    private:
+        std::vector<std::vector<std::unique_ptr<GuessScratch> > > owned_;
+        std::vector<std::vector<GuessScratch *> > free_;
+};
+
+#endif
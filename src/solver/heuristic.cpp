@@ -0,0 +1,96 @@
+#include "heuristic.h"
+#include <cmath>
+#include <memory>
+#include "epq.h"
+#include "../shared/enums.h"
+#include "../shared/grid.h"
+#include "../shared/structs.h"
+
+/* Tells whether an edge is on the lattice and set */
+static bool isSet(Grid const & grid, int i, int j, bool hline) {
+    if (hline) {
+        return i >= 0 && i <= grid.getHeight() && j >= 0 && j < grid.getWidth() && grid.getHLine(i, j) != EMPTY;
+    }
+    return i >= 0 && i < grid.getHeight() && j >= 0 && j <= grid.getWidth() && grid.getVLine(i, j) != EMPTY;
+}
+
+double NeighborHeuristic::score(Grid const & grid, EPQ const & epq, PrioEdge const & pe) const {
+    int i = pe.coords.i;
+    int j = pe.coords.j;
+    if (pe.h) {
+        return isSet(grid, i, j-1, true) + isSet(grid, i, j+1, true) +
+            isSet(grid, i+1, j, true) + isSet(grid, i-1, j, true) + isSet(grid, i-1, j+1, false) +
+            isSet(grid, i-1, j, false) + isSet(grid, i, j, false) + isSet(grid, i, j+1, false);
+    }
+    return isSet(grid, i-1, j, false) + isSet(grid, i+1, j, false) +
+        isSet(grid, i, j-1, false) + isSet(grid, i, j+1, false) + isSet(grid, i, j-1, true) +
+        isSet(grid, i+1, j-1, true) + isSet(grid, i, j, true) + isSet(grid, i+1, j, true);
+}
+
+double ContourHeuristic::score(Grid const & grid, EPQ const & epq, PrioEdge const & pe) const {
+    int ends[2][2] = { { pe.coords.i, pe.coords.j }, { pe.coords.i + !pe.h, pe.coords.j + pe.h } };
+    int steps[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+    double score = 0;
+    for (int e = 0; e < 2; e++) {
+        score += 2 * isEnd(grid, ends[e][0], ends[e][1]);
+        for (int s = 0; s < 4; s++) {
+            int i = ends[e][0] + steps[s][0];
+            int j = ends[e][1] + steps[s][1];
+            if (i != ends[1-e][0] || j != ends[1-e][1]) {
+                score += isEnd(grid, i, j);
+            }
+        }
+    }
+    return score;
+}
+
+/* Tells whether a point is on the lattice and the end of a contour */
+bool ContourHeuristic::isEnd(Grid const & grid, int i, int j) const {
+    return i >= 0 && i <= grid.getHeight() && j >= 0 && j <= grid.getWidth() && grid.getVertexLines(i, j) == 1;
+}
+
+double ClueHeuristic::score(Grid const & grid, EPQ const & epq, PrioEdge const & pe) const {
+    int i = pe.coords.i;
+    int j = pe.coords.j;
+    if (pe.h) {
+        return tightness(grid, i-1, j) + tightness(grid, i, j);
+    }
+    return tightness(grid, i, j-1) + tightness(grid, i, j);
+}
+
+/* Gives how close the number of a cell is to deciding its empty
+ * edges, from 0 for one that needs half of them to 1 for one that
+ * needs all or none, or 0 if the cell has no number */
+double ClueHeuristic::tightness(Grid const & grid, int i, int j) const {
+    if (i < 0 || i >= grid.getHeight() || j < 0 || j >= grid.getWidth() || grid.getNumber(i, j) == NONE) {
+        return 0;
+    }
+    int lines = grid.getLineCount(i, j);
+    int empties = 4 - lines - grid.getNLineCount(i, j);
+    if (empties == 0) {
+        return 0;
+    }
+    int needed = grid.getNumber(i, j) - ZERO - lines;
+    return std::abs(2*needed - empties) / (double)empties;
+}
+
+double AdaptiveHeuristic::score(Grid const & grid, EPQ const & epq, PrioEdge const & pe) const {
+    return epq.getActivity(pe);
+}
+
+/* Gives the heuristic for a way of ordering guesses, or none for
+ * the order the edges lie on the grid */
+std::shared_ptr<Heuristic const> makeHeuristic(Ordering ordering) {
+    switch (ordering) {
+        case NEIGHBOR_ORDERING:
+            return std::make_shared<NeighborHeuristic>();
+        case CONTOUR_ORDERING:
+            return std::make_shared<ContourHeuristic>();
+        case CLUE_ORDERING:
+            return std::make_shared<ClueHeuristic>();
+        case ADAPTIVE_ORDERING:
+            return std::make_shared<AdaptiveHeuristic>();
+        default:
+            return std::shared_ptr<Heuristic const>();
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef HEURISTIC_H
+#define HEURISTIC_H
+#include <memory>
+#include "epq.h"
+#include "../shared/enums.h"
+#include "../shared/grid.h"
+#include "../shared/structs.h"
+
+/* Ranks the edges of the EPQ at the start of each sweep, the edges it
+ * scores highest being guessed first. Without one, every edge keeps
+ * the priority it was queued with, less the times its guesses learned
+ * nothing, so the edges are gone over in the order they lie on the
+ * grid. The activities of the EPQ are only kept up for a heuristic
+ * that uses them. */
+class Heuristic {
+    public:
+        virtual ~Heuristic() { };
+        virtual double score(Grid const & grid, EPQ const & epq, PrioEdge const & pe) const = 0;
+        virtual bool usesActivity() const { return false; };
+};
+
+/* Scores an edge by how many of the edges that touch it, or run
+ * alongside it a cell away, are set */
+class NeighborHeuristic : public Heuristic {
+    public:
+        double score(Grid const & grid, EPQ const & epq, PrioEdge const & pe) const;
+};
+
+/* Scores an edge by the ends of contours at its ends, and, for less,
+ * at the points next to them */
+class ContourHeuristic : public Heuristic {
+    public:
+        double score(Grid const & grid, EPQ const & epq, PrioEdge const & pe) const;
+
+    private:
+        bool isEnd(Grid const & grid, int i, int j) const;
+};
+
+/* Scores an edge by how close each number beside it is to deciding
+ * the edges it has left, which is when it needs all or none of them */
+class ClueHeuristic : public Heuristic {
+    public:
+        double score(Grid const & grid, EPQ const & epq, PrioEdge const & pe) const;
+
+    private:
+        double tightness(Grid const & grid, int i, int j) const;
+};
+
+/* Scores an edge by its activity in the EPQ, so that the edges whose
+ * guesses learned something lately are guessed first */
+class AdaptiveHeuristic : public Heuristic {
+    public:
+        double score(Grid const & grid, EPQ const & epq, PrioEdge const & pe) const;
+        bool usesActivity() const { return true; };
+};
+
+std::shared_ptr<Heuristic const> makeHeuristic(Ordering ordering);
+
+#endif
@@ -0,0 +1,352 @@
+#include "loopconnectivity.h"
+#include <algorithm>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+#include "../shared/enums.h"
+#include "../shared/grid.h"
+
+/* Splits the edges that are not ruled out into blocks again if any
+ * edge was set since the last call, then rules out each edge that is
+ * in a block of its own or not in the block of the lines, and sets as
+ * lines the edges of that block that the loop cannot go without. Fails
+ * the grid if the lines are not all in one block of more than one
+ * edge. Gives whether any edge was set. */
+bool LoopConnectivity::propagate(Grid & grid) {
+    if (!grid.getFullSweep(CONNECTIVITY_QUEUE) && !grid.hasChanges(CONNECTIVITY_QUEUE)) {
+        return false;
+    }
+    grid.setFullSweep(CONNECTIVITY_QUEUE, false);
+    grid.discardChanges(CONNECTIVITY_QUEUE);
+
+    build(grid);
+    int lineBlock = -1;
+    for (int e = 0; e < edges_.size(); e++) {
+        if (edges_[e] != LINE) {
+            continue;
+        }
+        int b = blockOf_[e];
+        if (b == -1 || blockSizes_[b] < 2 || (lineBlock != -1 && b != lineBlock)) {
+            grid.setValid(false);
+            return false;
+        }
+        lineBlock = b;
+    }
+
+    /* ruling out edges outside a block leaves the block as it was, so
+     * the edges set here have nothing more to tell */
+    bool changed = false;
+    for (int e = 0; e < edges_.size() && grid.getValid(); e++) {
+        if (edges_[e] != EMPTY) {
+            continue;
+        }
+        int b = blockOf_[e];
+        if (b != -1 && blockSizes_[b] > 1 && (lineBlock == -1 || b == lineBlock)) {
+            continue;
+        }
+        setEdge(grid, e, NLINE);
+        changed = true;
+    }
+    if (lineBlock != -1 && grid.getValid()) {
+        changed = forceCuts(grid, lineBlock) || changed;
+    }
+    if (changed) {
+        grid.setUpdated(true);
+    }
+    grid.discardChanges(CONNECTIVITY_QUEUE);
+    return changed;
+}
+
+/* Reads the edges off the grid and splits them into blocks: those
+ * joined to the first line if there is one, or else all of them */
+void LoopConnectivity::build(Grid const & grid) {
+    m_ = grid.getHeight();
+    n_ = grid.getWidth();
+    edges_.resize((m_+1)*n_ + m_*(n_+1));
+    int line = -1;
+    for (int i = 0; i < m_+1; i++) {
+        for (int j = 0; j < n_+1; j++) {
+            if (j < n_) {
+                edges_[edgeOf(i, j, true)] = grid.getHLine(i, j);
+            }
+            if (i < m_) {
+                edges_[edgeOf(i, j, false)] = grid.getVLine(i, j);
+            }
+        }
+    }
+    for (int e = 0; e < edges_.size() && line == -1; e++) {
+        if (edges_[e] == LINE) {
+            line = e;
+        }
+    }
+
+    blocks_ = 0;
+    clock_ = 0;
+    blockOf_.assign(edges_.size(), -1);
+    blockSizes_.clear();
+    order_.assign((m_+1)*(n_+1), -1);
+    low_.resize(order_.size());
+    treeEdge_.assign(order_.size(), -1);
+    reached_.clear();
+    if (line != -1) {
+        int a;
+        int b;
+        endsOf(line, a, b);
+        search(a);
+        return;
+    }
+    for (int p = 0; p < order_.size(); p++) {
+        if (order_[p] == -1) {
+            search(p);
+        }
+    }
+}
+
+/* Gives the index of a horizontal or vertical edge */
+int LoopConnectivity::edgeOf(int i, int j, bool hline) const {
+    if (hline) {
+        return i*n_ + j;
+    }
+    return (m_+1)*n_ + i*(n_+1) + j;
+}
+
+/* Gives the two points at the ends of an edge */
+void LoopConnectivity::endsOf(int e, int & a, int & b) const {
+    if (e < (m_+1)*n_) {
+        a = (e / n_) * (n_+1) + e % n_;
+        b = a + 1;
+    } else {
+        a = e - (m_+1)*n_;
+        b = a + n_+1;
+    }
+}
+
+/* Gives the point that a point is joined to in one of four
+ * directions, along with the edge between them, or -1 if there is no
+ * edge that way or it is ruled out */
+int LoopConnectivity::neighbor(int p, int d, int & e) const {
+    int i = p / (n_+1);
+    int j = p % (n_+1);
+    int q = -1;
+    if (d == 0 && j < n_) {
+        e = edgeOf(i, j, true);
+        q = p + 1;
+    } else if (d == 1 && j > 0) {
+        e = edgeOf(i, j-1, true);
+        q = p - 1;
+    } else if (d == 2 && i < m_) {
+        e = edgeOf(i, j, false);
+        q = p + n_+1;
+    } else if (d == 3 && i > 0) {
+        e = edgeOf(i-1, j, false);
+        q = p - (n_+1);
+    }
+    if (q == -1 || edges_[e] == NLINE) {
+        return -1;
+    }
+    return q;
+}
+
+/* Goes depth first over the points joined to a point, keeping track
+ * of the earliest point each one reaches from below without going
+ * back the way it came. A point that nothing below another reaches
+ * past closes a block at the edge between them. The path is kept by
+ * hand, since it can be as long as there are points. */
+void LoopConnectivity::search(int root) {
+    order_[root] = low_[root] = clock_++;
+    reached_.push_back(root);
+    path_.assign(1, root);
+    next_.assign(1, 0);
+
+    while (!path_.empty()) {
+        int p = path_.back();
+        if (next_.back() == 4) {
+            int e = treeEdge_[p];
+            path_.pop_back();
+            next_.pop_back();
+            if (!path_.empty()) {
+                int u = path_.back();
+                low_[u] = std::min(low_[u], low_[p]);
+                if (low_[p] >= order_[u]) {
+                    popBlock(e);
+                }
+            }
+            continue;
+        }
+
+        int e;
+        int q = neighbor(p, next_.back()++, e);
+        if (q == -1 || e == treeEdge_[p]) {
+            continue;
+        }
+        if (order_[q] == -1) {
+            edgeStack_.push_back(e);
+            order_[q] = low_[q] = clock_++;
+            reached_.push_back(q);
+            treeEdge_[q] = e;
+            path_.push_back(q);
+            next_.push_back(0);
+        } else if (order_[q] < order_[p]) {
+            edgeStack_.push_back(e);
+            low_[p] = std::min(low_[p], order_[q]);
+        }
+    }
+}
+
+/* Makes a block of the edges searched since a given one, that one
+ * included */
+void LoopConnectivity::popBlock(int e) {
+    int size = 0;
+    int top;
+    do {
+        top = edgeStack_.back();
+        edgeStack_.pop_back();
+        blockOf_[top] = blocks_;
+        size++;
+    } while (top != e);
+    blockSizes_.push_back(size);
+    blocks_++;
+}
+
+/* Sets an edge, given by its index, on the grid */
+void LoopConnectivity::setEdge(Grid & grid, int e, Edge edge) const {
+    if (e < (m_+1)*n_) {
+        grid.setHLine(e / n_, e % n_, edge);
+    } else {
+        grid.setVLine((e - (m_+1)*n_) / (n_+1), (e - (m_+1)*n_) % (n_+1), edge);
+    }
+}
+
+/* Sets as lines the edges of each set of edges of the block of the
+ * lines that cut it into pieces round a ring, when one of them is a
+ * line already or when there are lines in two of the pieces. An edge
+ * of the block on the search tree is labelled by the edges off the tree
+ * that jump from below it to above it, and two edges cut the block
+ * when their labels agree. Gives whether any edge was set. */
+bool LoopConnectivity::forceCuts(Grid & grid, int lineBlock) {
+    jumps_.assign(order_.size(), 0);
+    below_.assign(order_.size(), 1);
+    linesBefore_.assign(clock_ + 1, 0);
+    int lines = 0;
+    for (int e = 0; e < edges_.size(); e++) {
+        if (blockOf_[e] != lineBlock) {
+            continue;
+        }
+        int a;
+        int b;
+        endsOf(e, a, b);
+        if (treeEdge_[a] != e && treeEdge_[b] != e) {
+            jumps_[a] ^= labelOf(e);
+            jumps_[b] ^= labelOf(e);
+        }
+        if (edges_[e] == LINE) {
+            linesBefore_[std::max(order_[a], order_[b]) + 1]++;
+            lines++;
+        }
+    }
+    for (int t = 0; t < clock_; t++) {
+        linesBefore_[t+1] += linesBefore_[t];
+    }
+
+    /* the labels of the points below a point cancel for the edges
+     * that jump between two of them, leaving those that jump out */
+    for (int t = clock_-1; t > 0; t--) {
+        int p = reached_[t];
+        int a;
+        int b;
+        endsOf(treeEdge_[p], a, b);
+        int u = a == p ? b : a;
+        jumps_[u] ^= jumps_[p];
+        below_[u] += below_[p];
+    }
+
+    cuts_.clear();
+    for (int e = 0; e < edges_.size(); e++) {
+        if (blockOf_[e] != lineBlock) {
+            continue;
+        }
+        int a;
+        int b;
+        endsOf(e, a, b);
+        if (treeEdge_[a] == e) {
+            cuts_.push_back(std::make_pair(jumps_[a], e));
+        } else if (treeEdge_[b] == e) {
+            cuts_.push_back(std::make_pair(jumps_[b], e));
+        } else {
+            cuts_.push_back(std::make_pair(labelOf(e), e));
+        }
+    }
+    std::sort(cuts_.begin(), cuts_.end());
+
+    bool changed = false;
+    for (int start = 0, end = 0; start < cuts_.size() && grid.getValid(); start = end) {
+        end = start + 1;
+        while (end < cuts_.size() && cuts_[end].first == cuts_[start].first) {
+            end++;
+        }
+        if (end - start < 2) {
+            continue;
+        }
+
+        bool forced = false;
+        for (int k = start; k < end && !forced; k++) {
+            forced = edges_[cuts_[k].second] == LINE;
+        }
+        for (int k = start+1; k < end && !forced; k++) {
+            forced = splitsLines(cuts_[start].second, cuts_[k].second, lines);
+        }
+        for (int k = start; k < end && forced && grid.getValid(); k++) {
+            if (edges_[cuts_[k].second] == EMPTY) {
+                setEdge(grid, cuts_[k].second, LINE);
+                changed = true;
+            }
+        }
+    }
+    return changed;
+}
+
+/* Gives the lines of the block below a point in the search, itself
+ * included, counting each at the lower of its two points */
+int LoopConnectivity::linesWithin(int p) const {
+    return linesBefore_[order_[p] + below_[p]] - linesBefore_[order_[p]];
+}
+
+/* Checks whether two edges of the block, with no line among them, that
+ * together cut it, have lines on both sides of the cut. One side is
+ * what lies below the upper of them on the search tree, less what lies
+ * below the lower one if it is on the tree as well. */
+bool LoopConnectivity::splitsLines(int x, int y, int lines) const {
+    int ends[2][2];
+    endsOf(x, ends[0][0], ends[0][1]);
+    endsOf(y, ends[1][0], ends[1][1]);
+    int below[2] = { -1, -1 };
+    for (int k = 0; k < 2; k++) {
+        int e = k == 0 ? x : y;
+        for (int s = 0; s < 2; s++) {
+            if (treeEdge_[ends[k][s]] == e) {
+                below[k] = ends[k][s];
+            }
+        }
+    }
+    if (below[0] == -1 && below[1] == -1) {
+        return false;
+    }
+
+    int side;
+    if (below[0] == -1 || below[1] == -1) {
+        side = linesWithin(below[0] == -1 ? below[1] : below[0]);
+    } else if (order_[below[0]] < order_[below[1]]) {
+        side = linesWithin(below[0]) - linesWithin(below[1]);
+    } else {
+        side = linesWithin(below[1]) - linesWithin(below[0]);
+    }
+    return side > 0 && side < lines;
+}
+
+/* Gives an edge a label that looks random, the same on every call */
+uint64_t LoopConnectivity::labelOf(int e) {
+    uint64_t z = (uint64_t)(e + 1) * 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
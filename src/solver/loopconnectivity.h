@@ -0,0 +1,64 @@
+#ifndef LOOPCONNECTIVITY_H
+#define LOOPCONNECTIVITY_H
+#include <stdint.h>
+#include <utility>
+#include <vector>
+#include "../shared/grid.h"
+
+/* The points of a grid joined by the edges that are not ruled out,
+ * split into blocks: sets of edges any two of which lie on a cycle
+ * that has no point twice. A loop has no point twice, so all of its
+ * edges are in one block, and an edge in a block of its own, one that
+ * would cut the points in two, is on no loop at all. So every line
+ * has to be in the same block, which has to have more than one edge,
+ * and every edge outside it is ruled out.
+ * Inside the block of the lines, two edges whose removal would cut it
+ * in two are found by labelling every edge off the search tree at
+ * random and every edge on it by the labels of the edges that jump
+ * over it: two edges cut the block exactly when their labels agree.
+ * The edges that share a label cut the block into pieces round a
+ * ring, and a loop that goes through two of the pieces, or along one
+ * of those edges, goes round the whole ring, so each of them is a
+ * line.
+ * The blocks are found again from the edges on the grid whenever some
+ * have been set, so rolling a guess back needs nothing undone. Once
+ * there is a line, only the points joined to it are searched, since
+ * every edge out of reach of it is ruled out anyway. */
+class LoopConnectivity {
+    public:
+        bool propagate(Grid & grid);
+
+    private:
+        void build(Grid const & grid);
+        int edgeOf(int i, int j, bool hline) const;
+        void endsOf(int e, int & a, int & b) const;
+        int neighbor(int p, int d, int & e) const;
+        void search(int root);
+        void popBlock(int e);
+        void setEdge(Grid & grid, int e, Edge edge) const;
+        bool forceCuts(Grid & grid, int lineBlock);
+        int linesWithin(int p) const;
+        bool splitsLines(int x, int y, int lines) const;
+        static uint64_t labelOf(int e);
+
+        int m_;
+        int n_;
+        int blocks_;
+        int clock_;         /* points reached so far */
+        std::vector<Edge> edges_;       /* value of each edge, by edge */
+        std::vector<int> blockOf_;      /* block of each edge, or -1 if it is ruled out or out of reach */
+        std::vector<int> blockSizes_;   /* edges in each block */
+        std::vector<int> order_;        /* when each point was reached, or -1 */
+        std::vector<int> low_;          /* earliest point reached from below each point */
+        std::vector<int> reached_;      /* the points in the order they were reached */
+        std::vector<int> treeEdge_;     /* edge each point was first reached by, or -1 */
+        std::vector<int> edgeStack_;    /* edges not yet in a block */
+        std::vector<int> path_;         /* points being searched from */
+        std::vector<int> next_;         /* direction each point on the path goes next */
+        std::vector<uint64_t> jumps_;   /* labels of the edges of the block jumping out from below each point */
+        std::vector<int> below_;        /* points below each point in the search, itself included */
+        std::vector<int> linesBefore_;  /* lines of the block below the points reached before each time */
+        std::vector<std::pair<uint64_t, int> > cuts_;   /* edges of the block by label */
+};
+
+#endif
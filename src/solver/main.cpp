@@ -1,53 +1,213 @@
+#include <chrono>
+#include <iomanip>
 #include <iostream>
 #include <fstream>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <time.h>
-#include "contradiction.h"
-#include "contradictions.h"
-#include "rule.h"
-#include "rules.h"
-#include "solver.h"
+#include <vector>
+#include "solverengine.h"
+#include "solvesession.h"
+#include "../shared/constants.h"
 #include "../shared/export.h"
 #include "../shared/grid.h"
 #include "../shared/import.h"
 #include "../shared/lattice.h"
+#include "../shared/structs.h"
+
+static char const * const ORDERING_NAMES[NUM_ORDERINGS] = { "flat", "neighbors", "contour", "clues", "adaptive" };
+
+/* An engine for grids of one size, along with the session that
+ * solves them */
+struct SizedSession {
+    std::unique_ptr<SolverEngine> engine;
+    std::unique_ptr<SolveSession> session;
+};
+
+/* Gives the session for grids of the size of the one given, making
+ * it the first time a grid of that size comes along, so that the rules
+ * are compiled and the session grows its storage once for each size */
+static SolveSession & sessionFor(std::vector<SizedSession> & sessions, Grid const & grid, int selectedRules[], SolverOptions const & options) {
+    for (int k = 0; k < sessions.size(); k++) {
+        if (sessions[k].engine->fits(grid)) {
+            return *sessions[k].session;
+        }
+    }
+
+    sessions.push_back(SizedSession());
+    SizedSession & sized = sessions.back();
+    sized.engine.reset(new SolverEngine(grid, selectedRules, NUM_RULES - NUM_CONST_RULES, 100, options));
+    sized.session.reset(new SolveSession(*sized.engine));
+    return *sized.session;
+}
+
+/* Solves each puzzle once with each heuristic, printing for each
+ * heuristic how many of the puzzles it solved, the guesses it made and
+ * the time it took */
+static void runBenchmark(std::vector<std::string> const & filenames, int selectedRules[], SolverOptions options) {
+    std::cout << std::left << std::setw(12) << "Heuristic" << std::right << std::setw(10) << "Solved"
+        << std::setw(12) << "Guesses" << std::setw(12) << "Seconds" << std::endl;
+
+    for (int o = 0; o < NUM_ORDERINGS; o++) {
+        options.ordering = (Ordering)o;
+        std::vector<SizedSession> sessions;
+        int solved = 0;
+        long guesses = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < filenames.size(); i++) {
+            Grid grid;
+            Import importer = Import(grid, filenames[i]);
+            SolveResult result = sessionFor(sessions, grid, selectedRules, options).solve(grid);
+            solved += grid.isSolved();
+            guesses += result.guesses;
+        }
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+        std::ostringstream count;
+        count << solved << "/" << filenames.size();
+        std::cout << std::left << std::setw(12) << ORDERING_NAMES[o] << std::right << std::setw(10) << count.str()
+            << std::setw(12) << guesses << std::setw(12) << std::fixed << std::setprecision(3) << seconds.count() << std::endl;
+    }
+}
 
 int main(int argc, char * argv[]) {
     clock_t startTime, endTime;
     startTime = clock();
 
-    Rule rules[NUM_RULES];
-    initRules(rules);
-    Contradiction contradictions[NUM_CONTRADICTIONS];
-    initContradictions(contradictions);
     int selectedRules[NUM_RULES - NUM_CONST_RULES];
     for (int i = 0; i < NUM_RULES - NUM_CONST_RULES; i++) {
         selectedRules[i] = i;
     }
 
+    SolverOptions options;
+    bool stats = false;
+    bool benchmark = false;
+    std::vector<std::string> filenames;
     for (int i = 1; i < argc; i++) {
-        char * filename = argv[i];
+        std::string arg = argv[i];
+        if (arg == "--engine=rules") {
+            options.engine = RULE_ENGINE;
+        } else if (arg == "--engine=sat") {
+            options.engine = SAT_ENGINE;
+        } else if (arg == "--engine=hybrid") {
+            options.engine = HYBRID_ENGINE;
+        } else if (arg.compare(0, 10, "--threads=") == 0) {
+            std::istringstream threads(arg.substr(10));
+            if (!(threads >> options.threads) || options.threads < 1) {
+                std::cout << "Invalid thread count " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg.compare(0, 8, "--table=") == 0) {
+            std::istringstream megabytes(arg.substr(8));
+            if (!(megabytes >> options.tableMegabytes) || options.tableMegabytes < 0) {
+                std::cout << "Invalid table size " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--probe-cache=on") {
+            options.probeCache = true;
+        } else if (arg == "--probe-cache=off") {
+            options.probeCache = false;
+        } else if (arg == "--learning=on") {
+            options.learning = true;
+        } else if (arg == "--learning=off") {
+            options.learning = false;
+        } else if (arg == "--coloring=on") {
+            options.coloring = true;
+        } else if (arg == "--coloring=off") {
+            options.coloring = false;
+        } else if (arg == "--connectivity=on") {
+            options.connectivity = true;
+        } else if (arg == "--connectivity=off") {
+            options.connectivity = false;
+        } else if (arg.compare(0, 12, "--heuristic=") == 0) {
+            int o = 0;
+            while (o < NUM_ORDERINGS && arg.substr(12) != ORDERING_NAMES[o]) {
+                o++;
+            }
+            if (o == NUM_ORDERINGS) {
+                std::cout << "Unknown heuristic " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+            options.ordering = (Ordering)o;
+        } else if (arg.compare(0, 8, "--local=") == 0) {
+            std::istringstream radius(arg.substr(8));
+            if (!(radius >> options.guessRadius) || options.guessRadius < 0) {
+                std::cout << "Invalid guess radius " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg.compare(0, 15, "--budget-rules=") == 0) {
+            std::istringstream rules(arg.substr(15));
+            if (!(rules >> options.ruleBudget) || options.ruleBudget < 0) {
+                std::cout << "Invalid rule budget " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg.compare(0, 17, "--budget-guesses=") == 0) {
+            std::istringstream guesses(arg.substr(17));
+            if (!(guesses >> options.guessBudget) || options.guessBudget < 0) {
+                std::cout << "Invalid guess budget " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg.compare(0, 12, "--budget-ms=") == 0) {
+            std::istringstream milliseconds(arg.substr(12));
+            if (!(milliseconds >> options.timeBudget) || options.timeBudget < 0) {
+                std::cout << "Invalid time budget " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--benchmark") {
+            benchmark = true;
+        } else if (arg == "--stats") {
+            stats = true;
+        } else if (arg.compare(0, 2, "--") == 0) {
+            std::cout << "Unknown option " << arg << std::endl;
+            return EXIT_FAILURE;
+        } else {
+            filenames.push_back(arg);
+        }
+    }
+
+    if (benchmark) {
+        runBenchmark(filenames, selectedRules, options);
+        return EXIT_SUCCESS;
+    }
+
+    std::vector<SizedSession> sessions;
+    for (int i = 0; i < filenames.size(); i++) {
+        std::string filename = filenames[i];
         std::cout << "Puzzle: " << filename << std::endl;
 
         Grid grid;
         Import importer = Import(grid, filename);
         Export exporter = Export(grid);
 
-        Solver solver = Solver(grid, rules, contradictions, selectedRules, NUM_RULES - NUM_CONST_RULES, 100);
+        SolveSession & session = sessionFor(sessions, grid, selectedRules, options);
+        SolveResult result = session.solve(grid);
 
         exporter.print();
 
-        if (grid.isSolved()) {
-            std::cout << "Solved" << std::endl;
-        } else {
-            if (solver.testContradictions()) {
+        switch (result.status) {
+            case SOLVED_STATUS:
+                std::cout << "Solved" << std::endl;
+                break;
+            case INVALID_STATUS:
                 std::cout << "Invalid puzzle" << std::endl;
-            } else if (solver.hasMultipleSolutions()) {
+                break;
+            case MULTIPLE_STATUS:
                 std::cout << "Puzzle has multiple solutions" << std::endl;
-            } else {
+                break;
+            default:
                 std::cout << "Not solved" << std::endl;
+                break;
+        }
+
+        if (stats) {
+            TableStats table = session.getTableStats();
+            std::cout << "Transposition table: " << table.lookups << " lookups, " << table.hits << " hits";
+            if (table.lookups > 0) {
+                std::cout << " (" << 100.0 * table.hits / table.lookups << "%)";
             }
+            std::cout << ", " << table.stores << " stores, " << table.evictions << " evictions" << std::endl;
+            std::cout << "Inconclusive guesses: " << result.inconclusive << std::endl;
         }
     }
 
@@ -0,0 +1,230 @@
+#include "patterntable.h"
+#include <algorithm>
+#include <cassert>
+#include <vector>
+#include "contradiction.h"
+#include "rotate.h"
+#include "rule.h"
+#include "../shared/constants.h"
+#include "../shared/enums.h"
+#include "../shared/structs.h"
+
+/* Whether a pattern in the given orientation is turned on its side,
+ * so that its horizontal lines land on vertical lines of the grid
+ * and vice versa. */
+static bool sideways(Orientation orient) {
+    switch (orient) {
+        case LEFT:
+        case RIGHT:
+        case LEFTFLIP:
+        case RIGHTFLIP:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Orders pattern elements so that two orientations with the same
+ * elements in a different order can be recognized as equal. */
+static bool elementLess(PatternElement const & a, PatternElement const & b) {
+    if (a.offset != b.offset) {
+        return a.offset < b.offset;
+    }
+    return a.value < b.value;
+}
+
+/* Expands every rule and contradiction into each of its eight
+ * orientations, resolving rotations, the plane each element lands
+ * on and its offset in a grid with the given row stride and plane
+ * starts. Orientations that come out identical to an earlier one
+ * because of the symmetry of the pattern are dropped. */
+void PatternTable::compile(Rule const rules[NUM_RULES], Contradiction const contradictions[NUM_CONTRADICTIONS], int stride, int hlineStart, int vlineStart) {
+    stride_ = stride;
+    hlineStart_ = hlineStart;
+    vlineStart_ = vlineStart;
+
+    elements_.clear();
+    rulePatterns_.clear();
+    contradictionPatterns_.clear();
+
+    for (int r = 0; r < NUM_RULES; r++) {
+        ruleStart_[r] = rulePatterns_.size();
+        addOrientations(rules[r], r, rulePatterns_);
+    }
+    ruleStart_[NUM_RULES] = rulePatterns_.size();
+
+    for (int x = 0; x < NUM_CONTRADICTIONS; x++) {
+        contradictionStart_[x] = contradictionPatterns_.size();
+        addOrientations(contradictions[x], x, contradictionPatterns_);
+    }
+    contradictionStart_[NUM_CONTRADICTIONS] = contradictionPatterns_.size();
+}
+
+/* Gives the farthest apart, in rows or columns, that two elements of
+ * any rule or contradiction can be, which bounds how far from an
+ * edge a pattern that sees it can look. */
+int PatternTable::getReach() const {
+    int reach = 0;
+    for (int k = 0; k < rulePatterns_.size(); k++) {
+        reach = std::max(reach, std::max(rulePatterns_[k].height, rulePatterns_[k].width));
+    }
+    for (int k = 0; k < contradictionPatterns_.size(); k++) {
+        reach = std::max(reach, std::max(contradictionPatterns_[k].height, contradictionPatterns_[k].width));
+    }
+    return reach;
+}
+
+/* Indexes the orientations of every rule and contradiction by each
+ * edge they check, so that setting an edge to a value wakes only the
+ * orientations with that value at that position relative to their
+ * anchor. Numbers never change while solving, so they are not
+ * indexed. */
+void PatternTable::indexTriggers() {
+    indexTriggers(rulePatterns_, ruleTriggers_, ruleTriggerStart_);
+    indexTriggers(contradictionPatterns_, contradictionTriggers_, contradictionTriggerStart_);
+}
+
+void PatternTable::indexTriggers(std::vector<CompiledPattern> const & patterns, std::vector<PatternTrigger> & triggers, int triggerStart[]) {
+    std::vector<PatternTrigger> byKey[6];
+
+    for (int k = 0; k < patterns.size(); k++) {
+        CompiledPattern const & pattern = patterns[k];
+        for (int e = pattern.checkStart; e < pattern.checkEnd; e++) {
+            PatternElement const & element = elements_[e];
+            if (element.plane == NUMBER_CELLS) {
+                continue;
+            }
+            int key = triggerKey(element.plane == HLINE_CELLS, (Edge)element.value);
+            byKey[key].push_back(PatternTrigger { k, element.di, element.dj });
+        }
+    }
+
+    triggers.clear();
+    for (int key = 0; key < 6; key++) {
+        triggerStart[key] = triggers.size();
+        triggers.insert(triggers.end(), byKey[key].begin(), byKey[key].end());
+    }
+    triggerStart[6] = triggers.size();
+}
+
+/* Only rules have diffs to apply */
+static void addDiffs(Rule const & rule, std::vector<EdgePosition> const * & hLineDiff, std::vector<EdgePosition> const * & vLineDiff) {
+    hLineDiff = rule.getHLineDiff();
+    vLineDiff = rule.getVLineDiff();
+}
+
+static void addDiffs(Contradiction const & contradiction, std::vector<EdgePosition> const * & hLineDiff, std::vector<EdgePosition> const * & vLineDiff) {
+    hLineDiff = NULL;
+    vLineDiff = NULL;
+}
+
+template <class Pattern>
+void PatternTable::addOrientations(Pattern const & source, int index, std::vector<CompiledPattern> & patterns) {
+    int m = source.getHeight();
+    int n = source.getWidth();
+    int first = patterns.size();
+
+    std::vector<EdgePosition> const * hLineDiff;
+    std::vector<EdgePosition> const * vLineDiff;
+    addDiffs(source, hLineDiff, vLineDiff);
+
+    for (Orientation orient : (Orientation[]){ UP, DOWN, LEFT, RIGHT, UPFLIP, DOWNFLIP, LEFTFLIP, RIGHTFLIP }) {
+        unsigned char hPlane = sideways(orient) ? VLINE_CELLS : HLINE_CELLS;
+        unsigned char vPlane = sideways(orient) ? HLINE_CELLS : VLINE_CELLS;
+        int mark = elements_.size();
+
+        CompiledPattern pattern;
+        pattern.index = index;
+        pattern.orient = orient;
+        pattern.height = source.getNumberHeight(orient);
+        pattern.width = source.getNumberWidth(orient);
+
+        pattern.checkStart = elements_.size();
+        std::vector<NumberPosition> const * numberPattern = source.getNumberPattern();
+        for (int k = 0; k < numberPattern->size(); k++) {
+            NumberPosition p = (*numberPattern)[k];
+            Coordinates adjusted = rotateNumber(p.coords.i, p.coords.j, m, n, orient);
+            addElement(NUMBER_CELLS, adjusted.i, adjusted.j, p.num);
+        }
+        std::vector<EdgePosition> const * hLinePattern = source.getHLinePattern();
+        for (int k = 0; k < hLinePattern->size(); k++) {
+            EdgePosition p = (*hLinePattern)[k];
+            Coordinates adjusted = rotateHLine(p.coords.i, p.coords.j, m, n, orient);
+            addElement(hPlane, adjusted.i, adjusted.j, p.edge);
+        }
+        std::vector<EdgePosition> const * vLinePattern = source.getVLinePattern();
+        for (int k = 0; k < vLinePattern->size(); k++) {
+            EdgePosition p = (*vLinePattern)[k];
+            Coordinates adjusted = rotateVLine(p.coords.i, p.coords.j, m, n, orient);
+            addElement(vPlane, adjusted.i, adjusted.j, p.edge);
+        }
+        pattern.checkEnd = elements_.size();
+
+        pattern.diffStart = elements_.size();
+        for (int k = 0; hLineDiff && k < hLineDiff->size(); k++) {
+            EdgePosition p = (*hLineDiff)[k];
+            Coordinates adjusted = rotateHLine(p.coords.i, p.coords.j, m, n, orient);
+            addElement(hPlane, adjusted.i, adjusted.j, p.edge);
+        }
+        for (int k = 0; vLineDiff && k < vLineDiff->size(); k++) {
+            EdgePosition p = (*vLineDiff)[k];
+            Coordinates adjusted = rotateVLine(p.coords.i, p.coords.j, m, n, orient);
+            addElement(vPlane, adjusted.i, adjusted.j, p.edge);
+        }
+        pattern.diffEnd = elements_.size();
+
+        std::sort(elements_.begin() + pattern.checkStart, elements_.begin() + pattern.checkEnd, elementLess);
+        std::sort(elements_.begin() + pattern.diffStart, elements_.begin() + pattern.diffEnd, elementLess);
+
+        bool duplicate = false;
+        for (int k = first; k < patterns.size() && !duplicate; k++) {
+            duplicate = sameAs(patterns[k], pattern);
+        }
+
+        if (duplicate) {
+            elements_.resize(mark);
+        } else {
+            patterns.push_back(pattern);
+        }
+    }
+}
+
+/* Adds an element at (di, dj) from the anchor on the given plane */
+void PatternTable::addElement(unsigned char plane, int di, int dj, unsigned char value) {
+    int offset = di * stride_ + dj;
+    if (plane == HLINE_CELLS) {
+        offset += hlineStart_;
+    } else if (plane == VLINE_CELLS) {
+        offset += vlineStart_;
+    }
+
+    elements_.push_back(PatternElement { offset, di, dj, plane, value });
+}
+
+/* Checks whether two compiled orientations test and set exactly
+ * the same elements over the same extent. */
+bool PatternTable::sameAs(CompiledPattern const & a, CompiledPattern const & b) const {
+    if (a.height != b.height || a.width != b.width
+            || a.checkEnd - a.checkStart != b.checkEnd - b.checkStart
+            || a.diffEnd - a.diffStart != b.diffEnd - b.diffStart) {
+        return false;
+    }
+
+    for (int k = 0; k < a.checkEnd - a.checkStart; k++) {
+        PatternElement const & x = elements_[a.checkStart + k];
+        PatternElement const & y = elements_[b.checkStart + k];
+        if (x.offset != y.offset || x.value != y.value) {
+            return false;
+        }
+    }
+
+    for (int k = 0; k < a.diffEnd - a.diffStart; k++) {
+        PatternElement const & x = elements_[a.diffStart + k];
+        PatternElement const & y = elements_[b.diffStart + k];
+        if (x.offset != y.offset || x.value != y.value) {
+            return false;
+        }
+    }
+
+    return true;
+}
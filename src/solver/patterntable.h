@@ -0,0 +1,91 @@
+#ifndef PATTERNTABLE_H
+#define PATTERNTABLE_H
+#include <vector>
+#include "contradiction.h"
+#include "rule.h"
+#include "../shared/constants.h"
+#include "../shared/enums.h"
+
+/* Which plane of the grid a pattern element lies on once the
+ * pattern has been rotated into place. */
+enum PatternPlane { NUMBER_CELLS, HLINE_CELLS, VLINE_CELLS };
+
+/* A single number or edge of a pattern, positioned relative to
+ * the anchor cell of the pattern. offset is the distance from the
+ * anchor's number to the element in the grid's block, so checking
+ * an element is one load and one compare. */
+struct PatternElement {
+    int offset;
+    int di;
+    int dj;
+    unsigned char plane;
+    unsigned char value;
+};
+
+/* A rule or contradiction in one of its orientations. Its checks
+ * and diffs are ranges of the table's element pool. */
+struct CompiledPattern {
+    int index;
+    Orientation orient;
+    int height;
+    int width;
+    int checkStart;
+    int checkEnd;
+    int diffStart;
+    int diffEnd;
+};
+
+/* A rule orientation that may have started to apply because an edge
+ * was set, along with where that edge lies relative to the anchor of
+ * the pattern. */
+struct PatternTrigger {
+    int pattern;
+    int di;
+    int dj;
+};
+
+class PatternTable {
+    public:
+        PatternTable() { };
+        void compile(Rule const rules[NUM_RULES], Contradiction const contradictions[NUM_CONTRADICTIONS], int stride, int hlineStart, int vlineStart);
+
+        int getStride() const { return stride_; };
+        int getReach() const;
+        CompiledPattern const * ruleBegin(int rule) const { return rulePatterns_.data() + ruleStart_[rule]; };
+        CompiledPattern const * ruleEnd(int rule) const { return rulePatterns_.data() + ruleStart_[rule+1]; };
+        CompiledPattern const * contradictionBegin(int x) const { return contradictionPatterns_.data() + contradictionStart_[x]; };
+        CompiledPattern const * contradictionEnd(int x) const { return contradictionPatterns_.data() + contradictionStart_[x+1]; };
+        PatternElement const * getElements() const { return elements_.data(); };
+        CompiledPattern const & getRulePattern(int k) const { return rulePatterns_[k]; };
+
+        CompiledPattern const & getContradictionPattern(int k) const { return contradictionPatterns_[k]; };
+
+        void indexTriggers();
+        PatternTrigger const * ruleTriggerBegin(bool hline, Edge edge) const { return ruleTriggers_.data() + ruleTriggerStart_[triggerKey(hline, edge)]; };
+        PatternTrigger const * ruleTriggerEnd(bool hline, Edge edge) const { return ruleTriggers_.data() + ruleTriggerStart_[triggerKey(hline, edge)+1]; };
+        PatternTrigger const * contradictionTriggerBegin(bool hline, Edge edge) const { return contradictionTriggers_.data() + contradictionTriggerStart_[triggerKey(hline, edge)]; };
+        PatternTrigger const * contradictionTriggerEnd(bool hline, Edge edge) const { return contradictionTriggers_.data() + contradictionTriggerStart_[triggerKey(hline, edge)+1]; };
+
+    private:
+        template <class Pattern>
+        void addOrientations(Pattern const & source, int index, std::vector<CompiledPattern> & patterns);
+        void addElement(unsigned char plane, int di, int dj, unsigned char value);
+        bool sameAs(CompiledPattern const & a, CompiledPattern const & b) const;
+        void indexTriggers(std::vector<CompiledPattern> const & patterns, std::vector<PatternTrigger> & triggers, int triggerStart[]);
+        static int triggerKey(bool hline, Edge edge) { return (hline ? 0 : 3) + edge; };
+
+        int stride_;
+        int hlineStart_;
+        int vlineStart_;
+        std::vector<PatternElement> elements_;
+        std::vector<CompiledPattern> rulePatterns_;
+        std::vector<CompiledPattern> contradictionPatterns_;
+        int ruleStart_[NUM_RULES+1];
+        int contradictionStart_[NUM_CONTRADICTIONS+1];
+        std::vector<PatternTrigger> ruleTriggers_;
+        std::vector<PatternTrigger> contradictionTriggers_;
+        int ruleTriggerStart_[7];   /* by edge value, horizontal then vertical */
+        int contradictionTriggerStart_[7];
+};
+
+#endif
@@ -0,0 +1,25 @@
+#include "probebudget.h"
+#include <atomic>
+#include <chrono>
+#include "../shared/structs.h"
+
+/* Starts the budget of a guess with the limits of the options, the
+ * time counting from now */
+ProbeBudget::ProbeBudget(SolverOptions const & options) : rules_(0), guesses_(0), spent_(false) {
+    ruleLimit_ = options.ruleBudget;
+    guessLimit_ = options.guessBudget;
+    timed_ = options.timeBudget > 0;
+    deadline_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(options.timeBudget);
+}
+
+/* Checks whether any of the limits has been reached */
+bool ProbeBudget::isSpent() const {
+    if (spent_) {
+        return true;
+    }
+    if ((ruleLimit_ > 0 && rules_ >= ruleLimit_) || (guessLimit_ > 0 && guesses_ >= guessLimit_)
+            || (timed_ && std::chrono::steady_clock::now() >= deadline_)) {
+        spent_ = true;
+    }
+    return spent_;
+}
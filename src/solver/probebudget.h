@@ -0,0 +1,29 @@
+#ifndef PROBEBUDGET_H
+#define PROBEBUDGET_H
+#include <atomic>
+#include <chrono>
+#include "../shared/structs.h"
+
+/* What a guess of the solver that started a tree may spend on rules,
+ * on guesses nested in it and on time before it is given up on,
+ * shared by every solver working on the guess, on whichever thread.
+ * A limit of 0 is no limit. Once the budget is spent it stays spent,
+ * so every solver of the guess winds down. */
+class ProbeBudget {
+    public:
+        ProbeBudget(SolverOptions const & options);
+        void spendRule() { rules_++; };
+        void spendGuess() { guesses_++; };
+        bool isSpent() const;
+
+    private:
+        long ruleLimit_;
+        long guessLimit_;
+        bool timed_;
+        std::chrono::steady_clock::time_point deadline_;
+        std::atomic<long> rules_;
+        std::atomic<long> guesses_;
+        mutable std::atomic<bool> spent_;
+};
+
+#endif
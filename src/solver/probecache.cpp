@@ -0,0 +1,143 @@
+#include "probecache.h"
+#include <algorithm>
+#include <vector>
+#include "../shared/enums.h"
+#include "../shared/grid.h"
+#include "../shared/structs.h"
+
+/* Takes the reach of the patterns, and the cache of the solver that
+ * made the guess, if any. The parent must outlive the cache and leave
+ * its grid alone for as long as the cache is in use. */
+ProbeCache::ProbeCache(Grid const & grid, int reach, ProbeCache const * parent) {
+    m_ = 0;
+    n_ = 0;
+    stride_ = 0;
+    reset(grid, reach, parent);
+}
+
+/* Forgets every probe and stamp, as though the cache had just been
+ * made for the grid and parent given */
+void ProbeCache::reset(Grid const & grid, int reach, ProbeCache const * parent) {
+    if (grid.getHeight() != m_ || grid.getWidth() != n_ || grid.getStride() != stride_) {
+        m_ = grid.getHeight();
+        n_ = grid.getWidth();
+        stride_ = grid.getStride();
+        entries_.assign(2 * (m_+1) * stride_, Entry { -1, 0, 0, 0, std::vector<int>() });
+        stored_.clear();
+    }
+    reach_ = reach;
+    clock_ = 0;
+    stamps_.assign((m_+1) * stride_, 0);
+    forget();
+    parent_ = parent;
+}
+
+/* Forgets every probe, keeping the points of each entry to be filled
+ * in again */
+void ProbeCache::forget() {
+    for (int k = 0; k < stored_.size(); k++) {
+        entries_[stored_[k]].stamp = -1;
+    }
+    stored_.clear();
+}
+
+/* Stamps the points around every edge set since the last sync, or
+ * forgets every probe if the grid has been filled in from scratch */
+void ProbeCache::sync(Grid & grid) {
+    if (grid.getFullSweep(PROBE_QUEUE)) {
+        forget();
+        parent_ = NULL;
+        grid.setFullSweep(PROBE_QUEUE, false);
+        grid.discardChanges(PROBE_QUEUE);
+        return;
+    }
+
+    while (grid.hasChanges(PROBE_QUEUE)) {
+        EdgeAssignment change = grid.popChange(PROBE_QUEUE);
+        touch(change);
+    }
+}
+
+/* Checks whether probing an edge with its rules kept within a radius
+ * of it, INT_MAX for none, is known to learn nothing, giving
+ * the rules that the probe applied if so. The most recent cache to
+ * have probed the edge decides. A loop left open because closing it
+ * would solve the puzzle is closed off by whatever sets an edge next,
+ * wherever that is, so no probe is skipped while there is one. */
+bool ProbeCache::lookup(Grid const & grid, int i, int j, bool hline, int radius, int & ruleCounts) const {
+    if (grid.hasPendingClosure()) {
+        return false;
+    }
+
+    int key = keyOf(i, j, hline);
+    ProbeCache const * cache = this;
+    while (cache->entries_[key].stamp < 0) {
+        cache = cache->parent_;
+        if (!cache) {
+            return false;
+        }
+    }
+
+    Entry const & entry = cache->entries_[key];
+    if (entry.radius < radius || grid.getOpenLoops() < entry.minOpenLoops) {
+        return false;
+    }
+    for (ProbeCache const * c = this; c != cache; c = c->parent_) {
+        if (!c->untouchedSince(entry, 0)) {
+            return false;
+        }
+    }
+    if (!cache->untouchedSince(entry, entry.stamp)) {
+        return false;
+    }
+
+    ruleCounts = entry.ruleCounts;
+    return true;
+}
+
+/* Remembers that probing an edge within a radius learned nothing,
+ * given the points its guesses touched and the fewest open contours
+ * it holds with */
+void ProbeCache::store(int i, int j, bool hline, int radius, std::vector<Coordinates> const & points, int minOpenLoops, int ruleCounts) {
+    Entry & entry = entries_[keyOf(i, j, hline)];
+    if (entry.stamp < 0) {
+        stored_.push_back(keyOf(i, j, hline));
+    }
+    entry.stamp = clock_;
+    entry.minOpenLoops = minOpenLoops;
+    entry.radius = radius;
+    entry.ruleCounts = ruleCounts;
+
+    entry.points.clear();
+    for (int k = 0; k < points.size(); k++) {
+        entry.points.push_back(points[k].i*stride_ + points[k].j);
+    }
+    std::sort(entry.points.begin(), entry.points.end());
+    entry.points.erase(std::unique(entry.points.begin(), entry.points.end()), entry.points.end());
+}
+
+/* Checks that none of the points of an entry has been stamped since
+ * the given time */
+bool ProbeCache::untouchedSince(Entry const & entry, int stamp) const {
+    for (int k = 0; k < entry.points.size(); k++) {
+        if (stamps_[entry.points[k]] > stamp) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Stamps every point within reach of either end of an edge */
+void ProbeCache::touch(EdgeAssignment const & change) {
+    clock_++;
+
+    int i = change.coords.i;
+    int j = change.coords.j;
+    int lastRow = std::min(i + !change.h + reach_, m_);
+    int lastCol = std::min(j + change.h + reach_, n_);
+    for (int r = std::max(i - reach_, 0); r <= lastRow; r++) {
+        for (int c = std::max(j - reach_, 0); c <= lastCol; c++) {
+            stamps_[r*stride_ + c] = clock_;
+        }
+    }
+}
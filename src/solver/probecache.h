@@ -0,0 +1,60 @@
+#ifndef PROBECACHE_H
+#define PROBECACHE_H
+#include <vector>
+#include "../shared/grid.h"
+#include "../shared/structs.h"
+
+/* Remembers the probes of depth 0 that learned nothing, along with
+ * the points that their guesses touched, so that a sweep can skip an
+ * edge whose surroundings have not changed since it was last probed.
+ * Each point is stamped with the time an edge was last set within the
+ * reach of the patterns from it. A guess of depth 0 only applies
+ * rules, which see no farther than that, and follows contours only as
+ * far as their ends, which move only when an edge is set there. So as
+ * long as none of the points it touched has been stamped since, and
+ * no contour it came close to closing could have become the last one
+ * open, probing the edge again would go exactly as it did before.
+ * A solver making a guess has a cache of its own that starts out
+ * with everything its parent knew, since the grid of the guess is
+ * the grid of the parent with edges added. What the parent knew about
+ * an edge holds for as long as neither cache has stamped its points.
+ * A local guess, whose rules are kept to a window around its edge,
+ * learns no more in a narrower window, so a probe that learned nothing
+ * is skipped in any window as wide as the one it was made in.
+ * A cache can be reset for another grid of the same size. The entry of
+ * each edge is kept along with the points it has grown to hold, so a
+ * cache that has been used for a while allocates nothing. */
+class ProbeCache {
+    public:
+        ProbeCache(Grid const & grid, int reach, ProbeCache const * parent);
+        void reset(Grid const & grid, int reach, ProbeCache const * parent);
+        void sync(Grid & grid);
+        bool lookup(Grid const & grid, int i, int j, bool hline, int radius, int & ruleCounts) const;
+        void store(int i, int j, bool hline, int radius, std::vector<Coordinates> const & points, int minOpenLoops, int ruleCounts);
+        void touch(EdgeAssignment const & change);
+
+    private:
+        struct Entry {
+            int stamp;          /* time the probe was made, or -1 if the edge has not been */
+            int minOpenLoops;   /* fewest open contours it holds with */
+            int radius;         /* how far from the edge its rules were applied, or INT_MAX for everywhere */
+            int ruleCounts;
+            std::vector<int> points;
+        };
+
+        int keyOf(int i, int j, bool hline) const { return (2 * (i*stride_ + j)) + hline; };
+        bool untouchedSince(Entry const & entry, int stamp) const;
+        void forget();
+
+        int m_;
+        int n_;
+        int stride_;
+        int reach_;
+        int clock_;
+        std::vector<int> stamps_;   /* time each point was last stamped, or 0 if never */
+        std::vector<Entry> entries_;    /* by edge */
+        std::vector<int> stored_;       /* edges that have an entry */
+        ProbeCache const * parent_;
+};
+
+#endif
@@ -0,0 +1,228 @@
+#include "satengine.h"
+#include <vector>
+#include "satsolver.h"
+#include "../shared/enums.h"
+#include "../shared/grid.h"
+#include "../shared/structs.h"
+
+/* Encodes the numbers and the edges already set on a grid */
+SatEngine::SatEngine(Grid const & grid) {
+    m_ = grid.getHeight();
+    n_ = grid.getWidth();
+    done_ = false;
+    sat_.setTheory(this);
+    from_.resize((m_+1)*n_ + m_*(n_+1));
+    to_.resize(from_.size());
+    for (int i = 0; i < m_+1; i++) {
+        for (int j = 0; j < n_+1; j++) {
+            if (j < n_) {
+                from_[variableOf(i, j, true)] = i*(n_+1) + j;
+                to_[variableOf(i, j, true)] = i*(n_+1) + j+1;
+            }
+            if (i < m_) {
+                from_[variableOf(i, j, false)] = i*(n_+1) + j;
+                to_[variableOf(i, j, false)] = (i+1)*(n_+1) + j;
+            }
+        }
+    }
+
+    std::vector<int> anyLine;
+    for (int v = 0; v < (m_+1)*n_ + m_*(n_+1); v++) {
+        sat_.addVariable();
+        anyLine.push_back(SatSolver::literalOf(v, true));
+    }
+    sat_.addClause(anyLine);
+
+    for (int i = 0; i < m_; i++) {
+        for (int j = 0; j < n_; j++) {
+            if (grid.getNumber(i, j) == NONE) {
+                continue;
+            }
+            std::vector<int> around;
+            around.push_back(variableOf(i, j, true));
+            around.push_back(variableOf(i+1, j, true));
+            around.push_back(variableOf(i, j, false));
+            around.push_back(variableOf(i, j+1, false));
+            addCount(around, 1u << (grid.getNumber(i, j) - ZERO));
+        }
+    }
+
+    for (int i = 0; i < m_+1; i++) {
+        for (int j = 0; j < n_+1; j++) {
+            addPoint(i, j);
+        }
+    }
+
+    for (int i = 0; i < m_+1; i++) {
+        for (int j = 0; j < n_+1; j++) {
+            if (j < n_ && grid.getHLine(i, j) != EMPTY) {
+                sat_.addClause(std::vector<int>(1, SatSolver::literalOf(variableOf(i, j, true), grid.getHLine(i, j) == LINE)));
+            }
+            if (i < m_ && grid.getVLine(i, j) != EMPTY) {
+                sat_.addClause(std::vector<int>(1, SatSolver::literalOf(variableOf(i, j, false), grid.getVLine(i, j) == LINE)));
+            }
+        }
+    }
+}
+
+/* Finds a single loop that satisfies the grid and has not been found
+ * before, giving false once there are none left. The value of every
+ * edge of the loop is given, and the loop is ruled out for the next
+ * call, so calling again tells whether the solution is unique. */
+bool SatEngine::nextLoop(std::vector<EdgeAssignment> & loop) {
+    if (!done_ && sat_.solve()) {
+        loop.clear();
+        for (int i = 0; i < m_+1; i++) {
+            for (int j = 0; j < n_+1; j++) {
+                if (j < n_) {
+                    Edge edge = sat_.getModelValue(variableOf(i, j, true)) ? LINE : NLINE;
+                    loop.push_back(EdgeAssignment { Coordinates { i, j }, edge, true });
+                }
+                if (i < m_) {
+                    Edge edge = sat_.getModelValue(variableOf(i, j, false)) ? LINE : NLINE;
+                    loop.push_back(EdgeAssignment { Coordinates { i, j }, edge, false });
+                }
+            }
+        }
+        blockLoop();
+        return true;
+    }
+
+    done_ = true;
+    return false;
+}
+
+/* Gives the variable of a horizontal or vertical edge */
+int SatEngine::variableOf(int i, int j, bool hline) const {
+    if (hline) {
+        return i*n_ + j;
+    }
+    return (m_+1)*n_ + i*(n_+1) + j;
+}
+
+/* Asks for none or two lines at a point */
+void SatEngine::addPoint(int i, int j) {
+    std::vector<int> edges;
+    if (j > 0) {
+        edges.push_back(variableOf(i, j-1, true));
+    }
+    if (j < n_) {
+        edges.push_back(variableOf(i, j, true));
+    }
+    if (i > 0) {
+        edges.push_back(variableOf(i-1, j, false));
+    }
+    if (i < m_) {
+        edges.push_back(variableOf(i, j, false));
+    }
+    addCount(edges, (1u << 0) | (1u << 2));
+}
+
+/* Tells whether none of the allowed counts, given as a mask, can be
+ * reached with some variables true and some more not yet set */
+static bool isRuledOut(unsigned allowed, int on, int open) {
+    return ((allowed >> on) & ((2u << open) - 1)) == 0;
+}
+
+/* Asks for the number of true variables among a few to be one of the
+ * allowed counts, given as a mask. Each partial assignment of them that
+ * can only end in another count is ruled out, leaving out those that
+ * set more than one that is already ruled out, so that propagation
+ * finds every value the count forces. */
+void SatEngine::addCount(std::vector<int> const & variables, unsigned allowed) {
+    int k = variables.size();
+    for (unsigned set = 0; set < (1u << k); set++) {
+        for (unsigned on = set; ; on = (on - 1) & set) {
+            int open = k - __builtin_popcount(set);
+            bool minimal = isRuledOut(allowed, __builtin_popcount(on), open);
+            for (int b = 0; b < k && minimal; b++) {
+                if ((set >> b) & 1) {
+                    minimal = !isRuledOut(allowed, __builtin_popcount(on & ~(1u << b)), open + 1);
+                }
+            }
+
+            if (minimal) {
+                std::vector<int> clause;
+                for (int b = 0; b < k; b++) {
+                    if ((set >> b) & 1) {
+                        clause.push_back(SatSolver::literalOf(variables[b], !((on >> b) & 1)));
+                    }
+                }
+                sat_.addClause(clause);
+            }
+            if (on == 0) {
+                break;
+            }
+        }
+    }
+}
+
+/* Gives the point standing for the set of a point */
+int SatEngine::findRoot(std::vector<int> & parents, int p) const {
+    while (parents[p] != p) {
+        parents[p] = parents[parents[p]];
+        p = parents[p];
+    }
+    return p;
+}
+
+/* Looks for a loop closed by the lines set so far while some line is
+ * off it, giving as the conflict that a line of the loop or the line
+ * off it is off, or one of the edges around the loop is on */
+bool SatEngine::findConflict(SatSolver const & solver, std::vector<int> & clause) {
+    int points = (m_+1) * (n_+1);
+    int edges = from_.size();
+    std::vector<int> parents(points);
+    for (int p = 0; p < points; p++) {
+        parents[p] = p;
+    }
+
+    int closing = -1;
+    for (int v = 0; v < edges; v++) {
+        if (!solver.isTrue(SatSolver::literalOf(v, true))) {
+            continue;
+        }
+        int a = findRoot(parents, from_[v]);
+        int b = findRoot(parents, to_[v]);
+        if (a != b) {
+            parents[a] = b;
+        } else if (closing == -1) {
+            closing = v;
+        }
+    }
+    if (closing == -1) {
+        return false;
+    }
+
+    int root = findRoot(parents, from_[closing]);
+    int other = -1;
+    clause.clear();
+    for (int v = 0; v < edges; v++) {
+        bool inside = findRoot(parents, from_[v]) == root;
+        bool across = findRoot(parents, to_[v]) == root;
+        if (inside != across) {
+            clause.push_back(SatSolver::literalOf(v, true));
+        } else if (!inside && other == -1 && solver.isTrue(SatSolver::literalOf(v, true))) {
+            other = v;
+        }
+    }
+    if (other == -1) {
+        return false;
+    }
+
+    clause.push_back(SatSolver::literalOf(closing, false));
+    clause.push_back(SatSolver::literalOf(other, false));
+    return true;
+}
+
+/* Rules out the loop of the model. A single loop that has every line
+ * of another is that loop, so it is enough that one of them is off. */
+void SatEngine::blockLoop() {
+    std::vector<int> clause;
+    for (int v = 0; v < sat_.getVariables(); v++) {
+        if (sat_.getModelValue(v)) {
+            clause.push_back(SatSolver::literalOf(v, false));
+        }
+    }
+    sat_.addClause(clause);
+}
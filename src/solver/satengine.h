@@ -0,0 +1,38 @@
+#ifndef SATENGINE_H
+#define SATENGINE_H
+#include <vector>
+#include "satsolver.h"
+#include "../shared/grid.h"
+#include "../shared/structs.h"
+
+/* Solves a grid as a SAT problem instead of with rules and guesses.
+ * Each edge of the lattice is a variable that is true for a line.
+ * Each number asks for exactly that many of the edges around it, each
+ * point for none or two of its edges, and the edges already set on
+ * the grid are taken as they are. None of this keeps the lines to a
+ * single loop, so the engine watches the search as a theory: as soon
+ * as the lines set so far close a loop while there are lines off it,
+ * that is a conflict, since no single loop can have an edge on both
+ * sides of a loop without crossing the edges around it. */
+class SatEngine : public SatTheory {
+    public:
+        SatEngine(Grid const & grid);
+        bool nextLoop(std::vector<EdgeAssignment> & loop);
+        bool findConflict(SatSolver const & solver, std::vector<int> & clause);
+
+    private:
+        int variableOf(int i, int j, bool hline) const;
+        void addPoint(int i, int j);
+        void addCount(std::vector<int> const & variables, unsigned allowed);
+        int findRoot(std::vector<int> & parents, int p) const;
+        void blockLoop();
+
+        int m_;
+        int n_;
+        SatSolver sat_;
+        bool done_;         /* every loop has been found */
+        std::vector<int> from_;     /* point at either end of each edge */
+        std::vector<int> to_;
+};
+
+#endif
@@ -0,0 +1,429 @@
+#include "satsolver.h"
+#include <algorithm>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#define RESTART_CONFLICTS 100   /* conflicts before the first restart */
+#define VARIABLE_DECAY 0.95
+#define CLAUSE_DECAY 0.999
+
+SatSolver::SatSolver() {
+    ok_ = true;
+    propagated_ = 0;
+    variableIncrement_ = 1;
+    clauseIncrement_ = 1;
+    learnts_ = 0;
+    maxLearnts_ = 0;
+    theory_ = NULL;
+}
+
+/* Adds a variable, giving its number */
+int SatSolver::addVariable() {
+    int v = assigns_.size();
+    assigns_.push_back(UNASSIGNED);
+    levels_.push_back(0);
+    reasons_.push_back(-1);
+    polarity_.push_back(false);
+    seen_.push_back(0);
+    activity_.push_back(0);
+    watches_.resize(2 * (v+1));
+    order_.push(std::make_pair(0.0, v));
+    return v;
+}
+
+/* Adds a clause, giving false if the formula can no longer be
+ * satisfied. Literals already false for good are left out, and a
+ * clause that is already satisfied for good is not kept at all. */
+bool SatSolver::addClause(std::vector<int> const & literals) {
+    if (!ok_) {
+        return false;
+    }
+
+    std::vector<int> sorted = literals;
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<int> kept;
+    for (int k = 0; k < sorted.size(); k++) {
+        int l = sorted[k];
+        if (valueOf(l) == TRUE || (k > 0 && sorted[k-1] == (l ^ 1))) {
+            return true;
+        } else if (valueOf(l) == UNASSIGNED && (k == 0 || sorted[k-1] != l)) {
+            kept.push_back(l);
+        }
+    }
+
+    if (kept.empty()) {
+        ok_ = false;
+    } else if (kept.size() == 1) {
+        enqueue(kept[0], -1);
+        ok_ = propagate() == -1;
+    } else {
+        clauses_.push_back(Clause { kept, false, 0 });
+        attach(clauses_.size() - 1);
+    }
+    return ok_;
+}
+
+/* Searches for an assignment that satisfies every clause, giving
+ * whether there is one. The assignment found is kept as the model,
+ * and the solver is left ready for more clauses. */
+bool SatSolver::solve() {
+    if (!ok_) {
+        return false;
+    }
+    if (maxLearnts_ == 0) {
+        maxLearnts_ = std::max(clauses_.size() / 3.0, 1000.0);
+    }
+
+    for (int restarts = 0; ; restarts++) {
+        Status status = search(luby(restarts) * RESTART_CONFLICTS);
+        if (status == SATISFIABLE) {
+            model_.resize(assigns_.size());
+            for (int v = 0; v < assigns_.size(); v++) {
+                model_[v] = assigns_[v] == TRUE;
+            }
+            cancelUntil(0);
+            return true;
+        } else if (status == UNSATISFIABLE) {
+            ok_ = false;
+            cancelUntil(0);
+            return false;
+        }
+
+        if (learnts_ >= maxLearnts_) {
+            reduceLearnts();
+            maxLearnts_ *= 1.1;
+        }
+    }
+}
+
+/* Gives the value of a literal under the current assignment */
+SatSolver::Value SatSolver::valueOf(int literal) const {
+    Value value = assigns_[literal >> 1];
+    if (value == UNASSIGNED) {
+        return UNASSIGNED;
+    }
+    return (Value)(value ^ (literal & 1));
+}
+
+/* Makes a literal true at the current decision level, because of a
+ * clause or, for a decision, of none */
+void SatSolver::enqueue(int literal, int reason) {
+    int v = literal >> 1;
+    assigns_[v] = (literal & 1) ? FALSE : TRUE;
+    levels_[v] = decisionLevel();
+    reasons_[v] = reason;
+    trail_.push_back(literal);
+}
+
+/* Watches the first two literals of a clause */
+void SatSolver::attach(int c) {
+    watches_[clauses_[c].literals[0]].push_back(c);
+    watches_[clauses_[c].literals[1]].push_back(c);
+}
+
+/* Makes true the last literal of each clause whose other literals are
+ * all false, until there are none, giving a clause whose literals are
+ * all false or -1. A clause that implies a literal has it first. */
+int SatSolver::propagate() {
+    int conflict = -1;
+    while (propagated_ < trail_.size() && conflict == -1) {
+        int falseLiteral = trail_[propagated_++] ^ 1;
+        std::vector<int> & watchers = watches_[falseLiteral];
+
+        int keep = 0;
+        int k = 0;
+        while (k < watchers.size()) {
+            int c = watchers[k++];
+            std::vector<int> & literals = clauses_[c].literals;
+            if (literals[0] == falseLiteral) {
+                std::swap(literals[0], literals[1]);
+            }
+            if (valueOf(literals[0]) == TRUE) {
+                watchers[keep++] = c;
+                continue;
+            }
+
+            bool moved = false;
+            for (int x = 2; x < literals.size() && !moved; x++) {
+                if (valueOf(literals[x]) != FALSE) {
+                    std::swap(literals[1], literals[x]);
+                    watches_[literals[1]].push_back(c);
+                    moved = true;
+                }
+            }
+            if (moved) {
+                continue;
+            }
+
+            watchers[keep++] = c;
+            if (valueOf(literals[0]) == FALSE) {
+                conflict = c;
+                while (k < watchers.size()) {
+                    watchers[keep++] = watchers[k++];
+                }
+            } else {
+                enqueue(literals[0], c);
+            }
+        }
+        watchers.resize(keep);
+    }
+    return conflict;
+}
+
+/* Keeps a clause from the theory that the assignment breaks. Its two
+ * literals that were made false last are watched. Where only one of
+ * them was made false at the last level either has, the search jumps
+ * back to the level of the other, where the clause implies it, giving
+ * -1; otherwise it jumps back to that last level and gives the clause
+ * as the conflict. */
+int SatSolver::addConflict(std::vector<int> const & literals) {
+    clauses_.push_back(Clause { literals, false, 0 });
+    int c = clauses_.size() - 1;
+    std::vector<int> & kept = clauses_[c].literals;
+    for (int w = 0; w < 2; w++) {
+        for (int k = w + 1; k < kept.size(); k++) {
+            if (levels_[kept[k] >> 1] > levels_[kept[w] >> 1]) {
+                std::swap(kept[w], kept[k]);
+            }
+        }
+    }
+    attach(c);
+
+    if (levels_[kept[1] >> 1] < levels_[kept[0] >> 1]) {
+        cancelUntil(levels_[kept[1] >> 1]);
+        enqueue(kept[0], c);
+        return -1;
+    }
+    cancelUntil(levels_[kept[0] >> 1]);
+    return c;
+}
+
+/* Resolves a conflict back to the first unique implication point of
+ * the current decision level, giving the clause learned, with the
+ * literal it will imply first, and the level to jump back to, which
+ * is that of its second literal */
+void SatSolver::analyze(int conflict, std::vector<int> & learnt, int & backtrackLevel) {
+    learnt.clear();
+    learnt.push_back(-1);
+
+    int pending = 0;
+    int literal = -1;
+    int index = trail_.size() - 1;
+    do {
+        Clause & clause = clauses_[conflict];
+        if (clause.learnt) {
+            bumpClause(clause);
+        }
+        for (int k = (literal == -1) ? 0 : 1; k < clause.literals.size(); k++) {
+            int q = clause.literals[k];
+            int v = q >> 1;
+            if (!seen_[v] && levels_[v] > 0) {
+                seen_[v] = 1;
+                bumpVariable(v);
+                if (levels_[v] >= decisionLevel()) {
+                    pending++;
+                } else {
+                    learnt.push_back(q);
+                }
+            }
+        }
+
+        while (!seen_[trail_[index] >> 1]) {
+            index--;
+        }
+        literal = trail_[index--];
+        conflict = reasons_[literal >> 1];
+        seen_[literal >> 1] = 0;
+        pending--;
+    } while (pending > 0);
+    learnt[0] = literal ^ 1;
+
+    backtrackLevel = 0;
+    for (int k = 1; k < learnt.size(); k++) {
+        seen_[learnt[k] >> 1] = 0;
+        if (levels_[learnt[k] >> 1] > backtrackLevel) {
+            backtrackLevel = levels_[learnt[k] >> 1];
+            std::swap(learnt[1], learnt[k]);
+        }
+    }
+}
+
+/* Undoes every assignment above a decision level, remembering the
+ * value each variable had */
+void SatSolver::cancelUntil(int level) {
+    if (decisionLevel() <= level) {
+        return;
+    }
+
+    for (int k = trail_.size() - 1; k >= trailLimits_[level]; k--) {
+        int v = trail_[k] >> 1;
+        polarity_[v] = assigns_[v] == TRUE;
+        assigns_[v] = UNASSIGNED;
+        reasons_[v] = -1;
+        order_.push(std::make_pair(activity_[v], v));
+    }
+    trail_.resize(trailLimits_[level]);
+    trailLimits_.resize(level);
+    propagated_ = trail_.size();
+}
+
+/* Gives the literal to decide next, for the most active variable that
+ * is not assigned, or -1 if every variable is */
+int SatSolver::pickBranchLiteral() {
+    if (order_.size() > 10 * assigns_.size() + 100) {
+        order_ = std::priority_queue<std::pair<double, int> >();
+        for (int v = 0; v < assigns_.size(); v++) {
+            if (assigns_[v] == UNASSIGNED) {
+                order_.push(std::make_pair(activity_[v], v));
+            }
+        }
+    }
+
+    while (!order_.empty()) {
+        std::pair<double, int> top = order_.top();
+        order_.pop();
+        int v = top.second;
+        if (assigns_[v] == UNASSIGNED && top.first == activity_[v]) {
+            return literalOf(v, polarity_[v]);
+        }
+    }
+    return -1;
+}
+
+/* Searches until every variable is assigned, the formula is found to
+ * be unsatisfiable, or a number of conflicts have been met, in which
+ * case the search goes back to the top to restart */
+SatSolver::Status SatSolver::search(int conflictBudget) {
+    int conflicts = 0;
+    std::vector<int> learnt;
+    std::vector<int> broken;
+    for (;;) {
+        int conflict = propagate();
+        if (conflict == -1 && theory_ && theory_->findConflict(*this, broken)) {
+            conflict = addConflict(broken);
+            if (conflict == -1) {
+                continue;
+            }
+        }
+        if (conflict != -1) {
+            conflicts++;
+            if (decisionLevel() == 0) {
+                return UNSATISFIABLE;
+            }
+
+            int backtrackLevel;
+            analyze(conflict, learnt, backtrackLevel);
+            cancelUntil(backtrackLevel);
+            if (learnt.size() == 1) {
+                enqueue(learnt[0], -1);
+            } else {
+                clauses_.push_back(Clause { learnt, true, 0 });
+                int c = clauses_.size() - 1;
+                attach(c);
+                bumpClause(clauses_[c]);
+                learnts_++;
+                enqueue(learnt[0], c);
+            }
+
+            variableIncrement_ /= VARIABLE_DECAY;
+            clauseIncrement_ /= CLAUSE_DECAY;
+        } else {
+            if (conflicts >= conflictBudget) {
+                cancelUntil(0);
+                return UNDECIDED;
+            }
+
+            int literal = pickBranchLiteral();
+            if (literal == -1) {
+                return SATISFIABLE;
+            }
+            trailLimits_.push_back(trail_.size());
+            enqueue(literal, -1);
+        }
+    }
+}
+
+/* Drops the less active half of the learned clauses longer than two
+ * literals. Only done with no decisions made, when no clause is needed
+ * as the reason for an assignment. */
+void SatSolver::reduceLearnts() {
+    std::vector<double> activities;
+    for (int c = 0; c < clauses_.size(); c++) {
+        if (clauses_[c].learnt && clauses_[c].literals.size() > 2) {
+            activities.push_back(clauses_[c].activity);
+        }
+    }
+    if (activities.empty()) {
+        return;
+    }
+    std::nth_element(activities.begin(), activities.begin() + activities.size() / 2, activities.end());
+    double median = activities[activities.size() / 2];
+
+    int keep = 0;
+    for (int c = 0; c < clauses_.size(); c++) {
+        Clause & clause = clauses_[c];
+        if (clause.learnt && clause.literals.size() > 2 && clause.activity < median) {
+            learnts_--;
+            continue;
+        }
+        if (keep != c) {
+            std::swap(clauses_[keep], clause);
+        }
+        keep++;
+    }
+    clauses_.resize(keep);
+
+    for (int l = 0; l < watches_.size(); l++) {
+        watches_[l].clear();
+    }
+    for (int c = 0; c < clauses_.size(); c++) {
+        attach(c);
+    }
+    for (int v = 0; v < reasons_.size(); v++) {
+        reasons_[v] = -1;
+    }
+}
+
+/* Makes a variable more likely to be decided soon */
+void SatSolver::bumpVariable(int variable) {
+    activity_[variable] += variableIncrement_;
+    if (activity_[variable] > 1e100) {
+        order_ = std::priority_queue<std::pair<double, int> >();
+        for (int v = 0; v < activity_.size(); v++) {
+            activity_[v] *= 1e-100;
+            order_.push(std::make_pair(activity_[v], v));
+        }
+        variableIncrement_ *= 1e-100;
+    } else {
+        order_.push(std::make_pair(activity_[variable], variable));
+    }
+}
+
+/* Makes a learned clause less likely to be dropped */
+void SatSolver::bumpClause(Clause & clause) {
+    clause.activity += clauseIncrement_;
+    if (clause.activity > 1e20) {
+        for (int c = 0; c < clauses_.size(); c++) {
+            clauses_[c].activity *= 1e-20;
+        }
+        clauseIncrement_ *= 1e-20;
+    }
+}
+
+/* Gives the term of the Luby sequence 1 1 2 1 1 2 4 1 1 2 ... at a
+ * given index, counting from 0 */
+int SatSolver::luby(int x) {
+    int size = 1;
+    int seq = 0;
+    while (size < x + 1) {
+        seq++;
+        size = 2*size + 1;
+    }
+    while (size - 1 != x) {
+        size = (size - 1) >> 1;
+        seq--;
+        x = x % size;
+    }
+    return 1 << seq;
+}
@@ -0,0 +1,90 @@
+#ifndef SATSOLVER_H
+#define SATSOLVER_H
+#include <queue>
+#include <utility>
+#include <vector>
+
+class SatSolver;
+
+/* Knowledge about a problem that is not put as clauses up front. It is
+ * consulted whenever propagation has run out, and may give a clause of
+ * at least two literals that the current assignment breaks, which the
+ * solver keeps for good and treats as any other conflict. */
+class SatTheory {
+    public:
+        virtual ~SatTheory() { };
+        virtual bool findConflict(SatSolver const & solver, std::vector<int> & clause) = 0;
+};
+
+/* A conflict-driven clause learning SAT solver. Variables are numbered
+ * from 0, and each has two literals, given by literalOf. Clauses may be
+ * added between calls to solve, which finds an assignment that
+ * satisfies all of them, so a formula can be refined one model at a
+ * time.
+ * Propagation watches two literals of each clause. A conflict is
+ * resolved back to its first unique implication point, the clause
+ * learned from it makes the search jump back, and the variables taking
+ * part in recent conflicts are decided first, with the value they
+ * last had. The search restarts after a number of conflicts that
+ * follows the Luby sequence, and the less active half of the learned
+ * clauses is dropped at a restart once there are too many of them.
+ * A theory may add clauses during the search. */
+class SatSolver {
+    public:
+        SatSolver();
+        int addVariable();
+        int getVariables() const { return assigns_.size(); };
+        bool addClause(std::vector<int> const & literals);
+        void setTheory(SatTheory * theory) { theory_ = theory; };
+        bool isTrue(int literal) const { return valueOf(literal) == TRUE; };
+        bool solve();
+        bool getModelValue(int variable) const { return model_[variable]; };
+        static int literalOf(int variable, bool value) { return 2*variable + !value; };
+
+    private:
+        enum Value : signed char { FALSE, TRUE, UNASSIGNED };
+        enum Status { SATISFIABLE, UNSATISFIABLE, UNDECIDED };
+
+        struct Clause {
+            std::vector<int> literals;
+            bool learnt;
+            double activity;
+        };
+
+        Value valueOf(int literal) const;
+        int decisionLevel() const { return trailLimits_.size(); };
+        void enqueue(int literal, int reason);
+        void attach(int c);
+        int propagate();
+        int addConflict(std::vector<int> const & literals);
+        void analyze(int conflict, std::vector<int> & learnt, int & backtrackLevel);
+        void cancelUntil(int level);
+        int pickBranchLiteral();
+        Status search(int conflictBudget);
+        void reduceLearnts();
+        void bumpVariable(int variable);
+        void bumpClause(Clause & clause);
+        static int luby(int x);
+
+        bool ok_;           /* no conflict has been found without any decision */
+        std::vector<Clause> clauses_;
+        std::vector<std::vector<int> > watches_;    /* clauses watching each literal */
+        std::vector<Value> assigns_;
+        std::vector<int> levels_;
+        std::vector<int> reasons_;      /* clause that implied each variable, or -1 */
+        std::vector<bool> polarity_;    /* value each variable had last */
+        std::vector<int> trail_;        /* literals made true, in order */
+        std::vector<int> trailLimits_;  /* where each decision level starts on the trail */
+        int propagated_;    /* literals of the trail propagated so far */
+        std::vector<char> seen_;
+        std::vector<double> activity_;
+        double variableIncrement_;
+        double clauseIncrement_;
+        std::priority_queue<std::pair<double, int> > order_;    /* variables by activity, with stale entries */
+        int learnts_;
+        double maxLearnts_;
+        std::vector<bool> model_;
+        SatTheory * theory_;
+};
+
+#endif
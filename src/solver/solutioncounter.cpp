@@ -0,0 +1,34 @@
+#include "solutioncounter.h"
+#include <vector>
+#include "frontiercounter.h"
+#include "satengine.h"
+#include "../shared/grid.h"
+#include "../shared/structs.h"
+
+int countSolutions(Grid const & grid, int limit) {
+    std::vector<EdgeAssignment> first;
+    return countSolutions(grid, first, limit);
+}
+
+/* Counts the loops of a narrow grid a frontier at a time, and where
+ * that is too wide or gives up, runs the SAT engine, whose search
+ * propagates the numbers and the degrees of the points, cuts off lines
+ * that close a loop too soon as it goes, and rules out each loop once
+ * it has been counted */
+int countSolutions(Grid const & grid, std::vector<EdgeAssignment> & first, int limit) {
+    FrontierCounter frontier(grid, limit);
+    if (frontier.isComplete()) {
+        if (frontier.getCount() > 0) {
+            frontier.getSolution(0, first);
+        }
+        return frontier.getCount();
+    }
+
+    SatEngine sat(grid);
+    std::vector<EdgeAssignment> loop;
+    int count = 0;
+    while (count < limit && sat.nextLoop(count == 0 ? first : loop)) {
+        count++;
+    }
+    return count;
+}
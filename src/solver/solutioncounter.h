@@ -0,0 +1,17 @@
+#ifndef SOLUTIONCOUNTER_H
+#define SOLUTIONCOUNTER_H
+#include <vector>
+#include "../shared/grid.h"
+#include "../shared/structs.h"
+
+/* Counts the single loops that satisfy a grid, along with the edges
+ * already set on it, stopping once limit of them have been found. The
+ * search is complete, so unlike the guesses of a solver of limited
+ * depth it always settles whether a puzzle has no solution, exactly
+ * one or more, and it finds the same solutions in the same order each
+ * time. The value of every edge of the first loop found may be given
+ * as well. */
+int countSolutions(Grid const & grid, int limit = 2);
+int countSolutions(Grid const & grid, std::vector<EdgeAssignment> & first, int limit = 2);
+
+#endif
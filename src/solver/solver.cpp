@@ -1,21 +1,47 @@
 #include "solver.h"
+#include <atomic>
 #include <cassert>
+#include <climits>
+#include <cstdlib>
+#include <algorithm>
+#include <utility>
+#include <memory>
+#include <stdint.h>
+#include <unordered_set>
 #include <vector>
+#include "clausedatabase.h"
+#include "clausewatches.h"
 #include "contradiction.h"
 #include "epq.h"
-#include "rotate.h"
+#include "gridarena.h"
+#include "guessarena.h"
+#include "heuristic.h"
+#include "patterntable.h"
+#include "probebudget.h"
+#include "probecache.h"
 #include "rule.h"
+#include "solutioncounter.h"
+#include "solverengine.h"
+#include "solvesession.h"
+#include "threadpool.h"
+#include "transpositiontable.h"
 #include "../shared/constants.h"
 #include "../shared/enums.h"
 #include "../shared/grid.h"
 #include "../shared/structs.h"
 
 #define MAX_DEPTH 100
+#define MAX_NOGOOD 12   /* most literals in a nogood worth keeping */
 
 /* Constructor takes a grid as input to solve */
-Solver::Solver(Grid & grid, Rule rules[NUM_RULES], Contradiction contradictions[NUM_CONTRADICTIONS], int selectedRules[], int selectLength, int depth) {
+Solver::Solver(Grid & grid, Rule rules[NUM_RULES], Contradiction contradictions[NUM_CONTRADICTIONS], int selectedRules[], int selectLength, int depth)
+    : Solver(grid, rules, contradictions, selectedRules, selectLength, depth, SolverOptions()) { }
+
+/* Constructor taking options that choose how the grid is solved */
+Solver::Solver(Grid & grid, Rule rules[NUM_RULES], Contradiction contradictions[NUM_CONTRADICTIONS], int selectedRules[], int selectLength, int depth, SolverOptions const & options) {
     grid_ = &grid;
     depth_ = depth;
+    options_ = options;
 
     multipleSolutions_ = false;
 
@@ -26,6 +52,13 @@ Solver::Solver(Grid & grid, Rule rules[NUM_RULES], Contradiction contradictions[
     selectedRules_ = selectedRules;
     ruleCounts_ = 0;
 
+    /* expand every rule and contradiction into its orientations once,
+     * to be shared by this solver and every solver it spawns */
+    std::shared_ptr<PatternTable> patterns(new PatternTable());
+    patterns->compile(rules_, contradictions_, grid_->getStride(), grid_->getHLineStart(), grid_->getVLineStart());
+    patterns->indexTriggers();
+    patterns_ = patterns;
+
     int selectedPlusBasic[selectLength+NUM_CONST_RULES];
     for (int i = 0; i < selectLength; i++) {
         selectedPlusBasic[i] = selectedRules[i];
@@ -35,30 +68,206 @@ Solver::Solver(Grid & grid, Rule rules[NUM_RULES], Contradiction contradictions[
         selectedPlusBasic[selectLength+ NUM_CONST_RULES - i] = (NUM_RULES - i);
     }
 
+    /* probe edges and guess both values of an edge in parallel,
+     * on scratch grids that the current grid is copied into */
+    cancel_ = NULL;
+    if (options_.threads > 1) {
+        pool_ = std::make_shared<ThreadPool>(options_.threads);
+        arena_ = std::make_shared<GridArena>(options_.threads);
+    }
+
+    /* remember the outcome of guesses for every solver of the tree */
+    parentProbes_ = NULL;
+    fromTable_ = false;
+    if (options_.tableMegabytes > 0) {
+        table_ = std::make_shared<TranspositionTable>((size_t)options_.tableMegabytes << 20);
+    }
+
+    /* learn nogoods from the guesses of every solver of the tree */
+    nested_ = false;
+    if (options_.learning) {
+        clauses_ = std::make_shared<ClauseDatabase>(*grid_);
+        watches_ = std::make_shared<ClauseWatches>(*clauses_);
+    }
+
+    /* rank the edges to guess and count the guesses of every solver
+     * of the tree */
+    heuristic_ = makeHeuristic(options_.ordering);
+    guesses_ = std::make_shared<std::atomic<long> >(0);
+    windowRadius_ = -1;
+    inconclusive_ = std::make_shared<std::atomic<long> >(0);
+
+    /* relate the colors of cells and split the edges into blocks by
+     * the edges set, on every grid */
+    if (options_.coloring) {
+        coloring_ = std::make_shared<CellColoring>();
+    }
+    if (options_.connectivity) {
+        connectivity_ = std::make_shared<LoopConnectivity>();
+    }
+
+    /* keep the solvers and lists of every guess of the tree to be
+     * used again by the next guess nested as deep */
+    ownGuessArena_.reset(new GuessArena(options_.threads));
+    guessArena_ = ownGuessArena_.get();
+
+    depthUsed_ = 0;
+    startSolving(selectedPlusBasic, selectLength);
+}
+
+/* Constructor for a solver started by a session. The rules and
+ * contradictions, already compiled, the options and the depth come
+ * from the engine, and all that the solver would otherwise make for
+ * itself comes from the session, which has emptied it for this grid. */
+Solver::Solver(Grid & grid, SolverEngine const & engine, SolveSession & session) {
+    grid_ = &grid;
+    depth_ = engine.depth_;
+    options_ = engine.options_;
+
+    multipleSolutions_ = false;
+
+    epq_ = std::move(session.spareEpq_);
+    epq_.clear();
+    epq_.copyPQ(session.epq_);
+
+    rules_ = engine.rules_;
+    contradictions_ = engine.contradictions_;
+    selectedRules_ = engine.selectedRules_.data();
+    ruleCounts_ = 0;
+    patterns_ = engine.patterns_;
+
+    cancel_ = NULL;
+    pool_ = session.pool_;
+    arena_ = session.arena_;
+
+    parentProbes_ = NULL;
+    spareProbes_ = std::move(session.probes_);
+    fromTable_ = false;
+    table_ = session.table_;
+
+    nested_ = false;
+    clauses_ = session.clauses_;
+    watches_ = session.watches_;
+
+    heuristic_ = engine.heuristic_;
+    guesses_ = session.guesses_;
+    windowRadius_ = -1;
+    inconclusive_ = session.inconclusive_;
+
+    coloring_ = session.coloring_;
+    connectivity_ = session.connectivity_;
+
+    guessArena_ = session.guessArena_.get();
+    depthUsed_ = 0;
+    startSolving(engine.selectedRules_.data(), engine.selectLength_);
+}
+
+/* Applies the rules selected along with the basic rules, which only
+ * need applying to the grid as it is given, then solves it with the
+ * rules selected */
+void Solver::startSolving(int const selectedPlusBasic[], int selectLength) {
     selectLength_ = selectLength + NUM_CONST_RULES;
-    applyRules(selectedPlusBasic);
+    if (options_.engine != SAT_ENGINE) {
+        applyRules(selectedPlusBasic);
+    }
     selectLength_ = selectLength;
 
     solve();
+}
 
+/* Constructor for a solver working on behalf of another, which does
+ * nothing until it is asked to */
+Solver::Solver(Grid & grid, Solver const & parent) {
+    inherit(grid, parent);
 }
 
-/* Constructor for when the EPQ should be passed down. */
-Solver::Solver(Grid & grid, Rule rules[NUM_RULES], Contradiction contradictions[NUM_CONTRADICTIONS], int selectedRules[], int selectLength, int depth, EPQ oldEPQ) {
+/* Starts a solver afresh on behalf of another. It shares the rules,
+ * contradictions, options, compiled patterns, threads, cancellation,
+ * budget, transposition table and scratch of its parent, what it
+ * knows of probes, its nogoods and its EPQ. On the grid of its parent
+ * it shares the watches on the nogoods, the coloring of the cells and
+ * the blocks of the edges as well, and on any other grid it keeps
+ * them itself, reusing those it kept for an earlier grid if nothing
+ * else holds them. Whatever else it kept from before is emptied
+ * rather than freed. */
+void Solver::inherit(Grid & grid, Solver const & parent) {
     grid_ = &grid;
-    depth_ = depth;
-
-    epq_.copyPQ(oldEPQ);
+    depth_ = parent.depth_;
+    options_ = parent.options_;
 
     multipleSolutions_ = false;
 
-    rules_ = rules;
-    contradictions_ = contradictions;
-    selectedRules_ = selectedRules;
-    selectLength_ = selectLength;
+    rules_ = parent.rules_;
+    contradictions_ = parent.contradictions_;
+    selectedRules_ = parent.selectedRules_;
+    selectLength_ = parent.selectLength_;
+    patterns_ = parent.patterns_;
+    pool_ = parent.pool_;
+    arena_ = parent.arena_;
+    cancel_ = parent.cancel_;
+    table_ = parent.table_;
+    fromTable_ = false;
+    parentProbes_ = parent.probes_.get();
+    if (probes_) {
+        spareProbes_ = std::move(probes_);
+    }
     ruleCounts_ = 0;
+    heuristic_ = parent.heuristic_;
+    guesses_ = parent.guesses_;
+    windowCenter_ = parent.windowCenter_;
+    windowRadius_ = parent.windowRadius_;
+    budget_ = parent.budget_;
+    inconclusive_ = parent.inconclusive_;
+    depthUsed_ = 0;
+    guessArena_ = parent.guessArena_;
+    epq_.clear();
+    epq_.copyPQ(parent.epq_);
+    footprint_.clear();
+    learned_.clear();
+
+    clauses_ = parent.clauses_;
+    nested_ = parent.nested_;
+    if (clauses_ && &grid == parent.grid_) {
+        watches_ = parent.watches_;
+    } else if (clauses_ && watches_.use_count() == 1) {
+        watches_->reset();
+    } else if (clauses_) {
+        watches_ = std::make_shared<ClauseWatches>(*clauses_);
+    }
+    if (options_.coloring && &grid == parent.grid_) {
+        coloring_ = parent.coloring_;
+    } else if (options_.coloring && coloring_.use_count() != 1) {
+        coloring_ = std::make_shared<CellColoring>();
+    }
+    if (options_.connectivity && &grid == parent.grid_) {
+        connectivity_ = parent.connectivity_;
+    } else if (options_.connectivity && connectivity_.use_count() != 1) {
+        connectivity_ = std::make_shared<LoopConnectivity>();
+    }
+}
 
-    solve();
+/* Gives a solver working on behalf of this one on a grid, made in the
+ * slot given the first time and started afresh after that */
+Solver & Solver::spawn(std::unique_ptr<Solver> & slot, Grid & grid) const {
+    if (!slot) {
+        slot.reset(new Solver(grid, *this));
+    } else {
+        slot->inherit(grid, *this);
+    }
+    return *slot;
+}
+
+/* Solves a guess that has just been made on the grid of a spawned
+ * solver, to the given depth. Only a guess of depth 0 is kept to the
+ * window of a local guess. */
+void Solver::startGuess(int depth) {
+    depth_ = depth;
+    if (depth > 0) {
+        windowRadius_ = -1;
+    }
+    nested_ = true;
+
+    solveGuess();
 }
 
 void Solver::resetSolver() {
@@ -66,26 +275,85 @@ void Solver::resetSolver() {
     multipleSolutions_ = false;
 }
 
-/* Runs a loop testing each contradiction in each orientation in
- * each valid position on the grid, checking if the contradiction
- * applies, and, if so, returning true. */
+/* Gives how solving the grid ended. A grid in contradiction is
+ * invalid even if the solver also found more than one solution along
+ * the way. */
+SolveStatus Solver::getStatus() const {
+    if (grid_->isSolved()) {
+        return SOLVED_STATUS;
+    } else if (testContradictions()) {
+        return INVALID_STATUS;
+    } else if (multipleSolutions_) {
+        return MULTIPLE_STATUS;
+    }
+    return UNSOLVED_STATUS;
+}
+
+/* Gives the counts of the transposition table shared by the tree of
+ * solvers, or zeroes if it has none */
+TableStats Solver::getTableStats() const {
+    if (!table_) {
+        return TableStats { 0, 0, 0, 0 };
+    }
+    return table_->getStats();
+}
+
+/* Checks if any contradiction applies to the grid. A point that
+ * cannot be on a loop marks the grid invalid as soon as it is made,
+ * and a number with more lines than it asks for, or too few edges
+ * left to get them, is known from the grid's counts, so neither
+ * needs any patterns. A nogood broken by an edge that the nogoods
+ * have not been applied to yet is looked for among the nogoods that
+ * have that edge.
+ * A fresh grid has each contradiction tested in each orientation in
+ * each valid position; after that, only the contradiction
+ * orientations that check for the value of an edge set since the
+ * last test are tested around that edge. An edge is only taken off
+ * the queue once nothing has been found around it, so testing again
+ * gives the same answer. */
 bool Solver::testContradictions() const {
+    return hitsContradiction() || breaksNogood();
+}
+
+/* Does the work of testContradictions but for the nogoods, which are
+ * only applied once the rules run out */
+bool Solver::hitsContradiction() const {
     if (grid_->containsClosedContours() && !grid_->isSolved()) {
         return true;
     }
-    for (int i = 0; i < grid_->getHeight(); i++) {
-        for (int j = 0; j < grid_->getWidth(); j++) {
-            if (grid_->getContraMatrix(i,j)) {
+    if (!grid_->getValid() || grid_->hasViolatedClues()) {
+        return true;
+    }
+
+    if (grid_->getFullSweep(CONTRADICTION_QUEUE)) {
+        for (int i = 0; i < grid_->getHeight(); i++) {
+            for (int j = 0; j < grid_->getWidth(); j++) {
                 for (int x = 0; x < NUM_CONTRADICTIONS; x++) {
-                    for (Orientation orient: (Orientation[]){ UP, DOWN, LEFT, RIGHT, UPFLIP, DOWNFLIP, LEFTFLIP, RIGHTFLIP }) {
-                        if (contradictionApplies(i, j, contradictions_[x], orient)) {
+                    CompiledPattern const * end = patterns_->contradictionEnd(x);
+                    for (CompiledPattern const * p = patterns_->contradictionBegin(x); p != end; p++) {
+                        if (contradictionApplies(i, j, *p)) {
                             return true;
                         }
                     }
                 }
-                grid_->setContraMatrix(i, j, false);
             }
         }
+        grid_->setFullSweep(CONTRADICTION_QUEUE, false);
+        grid_->discardChanges(CONTRADICTION_QUEUE);
+    }
+
+    while (grid_->hasChanges(CONTRADICTION_QUEUE)) {
+        EdgeAssignment change = grid_->peekChange(CONTRADICTION_QUEUE);
+        PatternTrigger const * end = patterns_->contradictionTriggerEnd(change.h, change.edge);
+        for (PatternTrigger const * t = patterns_->contradictionTriggerBegin(change.h, change.edge); t != end; t++) {
+            CompiledPattern const & pattern = patterns_->getContradictionPattern(t->pattern);
+            int i = change.coords.i - t->di;
+            int j = change.coords.j - t->dj;
+            if (i >= 0 && j >= 0 && contradictionApplies(i, j, pattern)) {
+                return true;
+            }
+        }
+        grid_->popChange(CONTRADICTION_QUEUE);
     }
 
     return false;
@@ -95,88 +363,230 @@ bool Solver::testContradictions() const {
  * recursive guessing to find a solution to a puzzle */
 void Solver::solve() {
     grid_->setUpdated(true);
-    while (grid_->getUpdated() && !grid_->isSolved()) {
+    if (usesSat()) {
+        solveBySat();
+        return;
+    }
+    keepSolving();
+}
+
+/* Checks whether the SAT engine solves the grid of this solver: always
+ * for the SAT engine, and for the hybrid wherever the rule engine would
+ * guess without a depth limit */
+bool Solver::usesSat() const {
+    return options_.engine == SAT_ENGINE || (options_.engine == HYBRID_ENGINE && depth_ >= MAX_DEPTH);
+}
+
+/* Solves the grid with the SAT engine, after applying the rules for
+ * the hybrid. The solution is set on the grid if there is exactly
+ * one; otherwise the grid is failed if there is none, and left as it
+ * is but for the rules if there are several. */
+void Solver::solveBySat() {
+    if (options_.engine == HYBRID_ENGINE) {
         applyRules(selectedRules_);
+    }
+    if (!grid_->getValid() || testContradictions()) {
+        return;
+    }
 
-        for (int d = 0; d < depth_; d++) {
-            if (!grid_->getUpdated() && !testContradictions() && !grid_->isSolved() && !multipleSolutions_) {
-                solveDepth(d);
-            }
-        }
+    std::vector<EdgeAssignment> loop;
+    int solutions = countSolutions(*grid_, loop);
+    if (solutions == 0) {
+        grid_->setValid(false);
+    } else if (solutions > 1) {
+        multipleSolutions_ = true;
+    } else {
+        grid_->applyAssignments(loop);
     }
+    grid_->setUpdated(false);
 }
 
-/* */
-void Solver::updateEPQ() {
-    epq_.empty();
+/* Solves the grid for a guess that has just been made on it. If a
+ * solver of the same depth has been through the same state before,
+ * the edges it set are replayed instead, and otherwise what this
+ * solver makes of the state is stored for the next one. Besides the
+ * grid, the outcome of a search depends on its depth and, once it
+ * makes guesses, on the order of the EPQ; given all three it is
+ * always the same, so the table changes how fast a tree of solvers
+ * gets somewhere but never where it gets to. The nogoods and facts
+ * it can use count as well; they only change between sweeps of the
+ * solver that started the tree, so their generation is enough to tell
+ * them apart, and so does the window of a local guess, which leaves the
+ * rules short of where they would otherwise get. What an edge followed
+ * from and the nogoods learned are kept along with the edges, so that
+ * replaying them leaves the solver knowing all that the search would
+ * have.
+ * Every search starts out by applying rules until they run out, which
+ * is all that a search of depth 0 does. Before guessing at any depth,
+ * every edge has been guessed at depth 0, so a deeper search can
+ * nearly always pick up from the rules having been applied to its
+ * grid by a shallower one. */
+void Solver::solveGuess() {
+    if (!table_) {
+        solve();
+        return;
+    }
 
-    int m = grid_->getHeight();
-    int n = grid_->getWidth();
-    for (int i = 1; i < m ; i++) {
-        for (int j = 1; j < n-1; j++) {
-            if (grid_->getHLine(i,j) != EMPTY) {
-                continue;
-            }
-            float prio = grid_->getHLine(i,j-1) != EMPTY + grid_->getHLine(i,j+1) != EMPTY +
-            grid_->getHLine(i+1,j) != EMPTY + grid_->getHLine(i-1,j) != EMPTY + grid_->getVLine(i-1,j+1) != EMPTY +
-            grid_->getVLine(i-1,j) != EMPTY + grid_->getVLine(i,j) != EMPTY + grid_->getVLine(i,j+1) != EMPTY;
+    uint64_t gridHash = grid_->getHash();
+    uint64_t clauseHash = clauses_ ? (uint64_t)(clauses_->getGeneration() + 1) * 0xc2b2ae3d27d4eb4fULL : 0;
+    uint64_t searchHash = searchHashOf(0) ^ clauseHash;
+    if (windowRadius_ >= 0) {
+        uint64_t window = ((uint64_t)windowRadius_ << 40) ^ ((uint64_t)windowCenter_.i << 20) ^ windowCenter_.j;
+        searchHash ^= (window + 1) * 0xff51afd7ed558ccdULL;
+    }
+    if (depth_ > 0) {
+        searchHash = searchHashOf(depth_) ^ epq_.hash() ^ clauseHash;
+    }
 
-            if (prio > 0) {
-                epq_.emplace(prio, i, j, true);
-            }
-        }
+    if (table_->lookup(gridHash, searchHash, outcome_)) {
+        replay(outcome_);
+        multipleSolutions_ = outcome_.multipleSolutions;
+        fromTable_ = true;
+        return;
     }
 
-    for (int i = 1; i < m-1; i++) {
-        for (int j = 1; j < n; j++) {
-            if (grid_->getVLine(i,j) != EMPTY) {
-                continue;
-            }
-            float prio = grid_->getVLine(i-1,j) != EMPTY + grid_->getVLine(i+1,j) != EMPTY +
-            grid_->getVLine(i,j-1) != EMPTY + grid_->getVLine(i,j+1) != EMPTY + grid_->getHLine(i,j-1) != EMPTY +
-            grid_->getHLine(i+1,j-1) != EMPTY + grid_->getHLine(i,j) != EMPTY + grid_->getHLine(i+1,j) != EMPTY;
+    int mark = grid_->getChangeCount();
+    if (depth_ > 0 && table_->lookup(gridHash, searchHashOf(0) ^ clauseHash, rulesOutcome_)) {
+        replay(rulesOutcome_);
+        grid_->discardChanges(RULE_QUEUE);
+    }
+
+    solve();
+    if (cancelled()) {
+        return;
+    }
+
+    grid_->getChangesSince(mark, outcome_.deductions, outcome_.causes);
+    outcome_.nogoods = learned_;
+    outcome_.contradiction = testContradictions();
+    outcome_.multipleSolutions = multipleSolutions_;
+    outcome_.ruleCounts = ruleCounts_;
+    table_->store(gridHash, searchHash, outcome_);
+}
 
-            if (prio > 0) {
-                epq_.emplace(prio, i, j, false);
+/* Hashes the depth of a search for the transposition table */
+uint64_t Solver::searchHashOf(int depth) {
+    return (uint64_t)(depth + 1) * 0x9e3779b97f4a7c15ULL;
+}
+
+/* Sets the edges that an earlier solver set on the same grid, and
+ * fails the grid if it ended in a contradiction */
+void Solver::replay(GuessOutcome const & outcome) {
+    grid_->applyAssignments(outcome.deductions, outcome.causes);
+    learned_.insert(learned_.end(), outcome.nogoods.begin(), outcome.nogoods.end());
+    if (outcome.contradiction) {
+        grid_->setValid(false);
+    }
+    ruleCounts_ = ruleCounts_ + outcome.ruleCounts;
+}
+
+/* Applies rules and makes guesses for as long as either changes the
+ * grid, or until the solver is cancelled */
+void Solver::keepSolving() {
+    while (grid_->getUpdated() && !grid_->isSolved() && grid_->getValid() && !cancelled()) {
+        applyRules(selectedRules_);
+        guessDepths(0);
+    }
+}
+
+/* Makes guesses of each depth from the given one up to the depth of
+ * the solver, until one of them changes the grid. Guesses of the next
+ * depth make guesses of this one within them, so once a sweep that
+ * learned nothing had a guess run out of budget, the deeper sweeps
+ * would only run out too, and are not made. */
+void Solver::guessDepths(int from) {
+    for (int d = from; d < depth_; d++) {
+        if (!grid_->getUpdated() && !testContradictions() && !grid_->isSolved() && !multipleSolutions_) {
+            long inconclusive = *inconclusive_;
+            depthUsed_ = std::max(depthUsed_, d + 1);
+            solveDepth(d);
+            if (!grid_->getUpdated() && *inconclusive_ > inconclusive) {
+                return;
             }
         }
     }
-    epqSize_ = epq_.size();
 }
 
+/* Carries on with a solver that has finished at its depth as though
+ * it had been given a greater depth to begin with. Until it runs out
+ * of guesses, a solver takes the same steps whatever its depth, so
+ * picking up with the guesses it never got to make ends where the
+ * deeper solver would have. Where the SAT engine takes over at the
+ * greater depth, it is handed the grid as it is. */
+void Solver::deepen(int depth) {
+    int from = depth_;
+    depth_ = depth;
+    if (usesSat()) {
+        solveBySat();
+        return;
+    }
+    guessDepths(from);
+    keepSolving();
+}
+
+/* Ranks the edges of the EPQ that are still empty by the heuristic,
+ * if there is one */
+void Solver::updateEPQ() {
+    if (!heuristic_) {
+        return;
+    }
+
+    std::vector<PrioEdge> queued = epq_.copyPQToVector();
+    for (int k = 0; k < queued.size(); k++) {
+        if (getLine(queued[k].coords.i, queued[k].coords.j, queued[k].h) == EMPTY) {
+            epq_.rescore(queued[k], heuristic_->score(*grid_, epq_, queued[k]));
+        }
+    }
+}
 
 /* Make a guess in each valid position in the graph */
 void Solver::solveDepth(int depth) {
+    updateEPQ();
+    if (publishNogoods()) {
+        return;
+    }
+
+    if (pool_ && depth > 0) {
+        solveDepthParallel(depth);
+        return;
+    }
+
     bool usingPrioQueue = true;
 
+    if (depth == 0 && options_.probeCache) {
+        if (!probes_ && spareProbes_) {
+            probes_ = std::move(spareProbes_);
+            probes_->reset(*grid_, patterns_->getReach(), parentProbes_);
+        } else if (!probes_) {
+            probes_.reset(new ProbeCache(*grid_, patterns_->getReach(), parentProbes_));
+        }
+        probes_->sync(*grid_);
+    }
+
+    if (depth == 0 && options_.guessRadius > 0 && guessLocally()) {
+        return;
+    }
+
     if (usingPrioQueue) {
         int initSize = epq_.size();
         int guesses = 0;
 
-        while (!epq_.empty() && guesses++ < initSize && !multipleSolutions_) {
+        while (!epq_.empty() && guesses++ < initSize && !multipleSolutions_ && !cancelled()) {
 
             PrioEdge pe = epq_.top();
 
-            if (pe.h) {
-                makeHLineGuess(pe.coords.i, pe.coords.j, depth);
-                if (grid_->getHLine(pe.coords.i, pe.coords.j) == EMPTY) {
-                    pe.priority = pe.priority - 1;
-                    epq_.push(pe);
-                }
-                if (grid_->getUpdated()) {
-                    break;
-                }
-            } else {
-                makeVLineGuess(pe.coords.i, pe.coords.j, depth);
-                if (grid_->getVLine(pe.coords.i, pe.coords.j) == EMPTY) {
-                    pe.priority = pe.priority - 1;
-                    epq_.push(pe);
-                }
-                if (grid_->getUpdated()) {
-                    break;
+            probeEdge(pe, depth);
+            if (getLine(pe.coords.i, pe.coords.j, pe.h) != EMPTY) {
+                epq_.pop();
+            } else if (!grid_->getUpdated()) {
+                epq_.lower(pe);
+            }
+            if (grid_->getUpdated()) {
+                if (heuristic_ && heuristic_->usesActivity()) {
+                    epq_.reward(pe);
                 }
+                break;
             }
-            epq_.pop();
         }
     } else {
         for (int i = 0; i < grid_->getHeight()+1; i++) {
@@ -195,478 +605,1145 @@ void Solver::solveDepth(int depth) {
     }
 }
 
-/* Horizontal guess at the given location to the given depth */
-void Solver::makeHLineGuess(int i, int j, int depth) {
-    assert(0 <= i && i < grid_->getHeight()+1 && 0 <= j && j < grid_->getWidth());
-    assert(depth >= 0);
+/* Guesses the edge at the top of the EPQ in the sweep of solveDepth.
+ * A guess of depth 0 that learns nothing is remembered along with the
+ * points it touched, and skipped until something near them changes,
+ * as it would only learn nothing again, or for a local guess, as it
+ * would in a window no wider than the one it was made in. A local
+ * guess that never came near the edge of its window went as it would
+ * have without one, and is remembered as such. A guess that ran out
+ * of budget is never remembered. */
+void Solver::probeEdge(PrioEdge const & pe, int depth) {
+    bool caching = depth == 0 && probes_ && getLine(pe.coords.i, pe.coords.j, pe.h) == EMPTY;
+    int radius = windowRadius_ < 0 ? INT_MAX : windowRadius_;
+    int ruleCounts;
+    if (caching && probes_->lookup(*grid_, pe.coords.i, pe.coords.j, pe.h, radius, ruleCounts)) {
+        ruleCounts_ = ruleCounts_ + ruleCounts;
+        return;
+    }
 
-    if (grid_->getHLine(i, j) == EMPTY) {
-        /* there is only one case where the grid
-         * will not be updated, which is handled
-         * at the end of this iteration. */
-        grid_->setUpdated(true);
-
-        Grid lineGuess;
-        grid_->copy(lineGuess);
-
-        /* make a LINE guess */
-        lineGuess.setHLine(i, j, LINE);
-        Solver lineSolver = Solver(lineGuess, rules_, contradictions_, selectedRules_, selectLength_, depth, epq_);
-        ruleCounts_ = ruleCounts_ + lineSolver.ruleCounts_;
-
-        /* If this guess happens to solve the puzzle we need to make sure that
-         * the opposite guess leads to a contradiction, otherwise we know that
-         * there might be multiple solutions */
-        if (lineGuess.isSolved()) {
-            Grid nLineGuess;
-            grid_->copy(nLineGuess);
-            nLineGuess.setHLine(i, j, NLINE);
-            Solver nLineSolver = Solver(nLineGuess, rules_, contradictions_, selectedRules_, selectLength_, MAX_DEPTH, epq_);
-            ruleCounts_ = ruleCounts_ + nLineSolver.ruleCounts_;
-            if (nLineSolver.testContradictions()) {
-                /* The opposite guess leads to a contradiction
-                 * so the previous found solution is the only one */
-                lineGuess.copy(*grid_);
-            } else if (nLineGuess.isSolved() || nLineSolver.hasMultipleSolutions()) {
-                /* The opposite guess also led to a solution
-                 * so there are multiple solutions */
-                multipleSolutions_ = true;
-            } else {
-                /* The opposite guess led to neither a solution or
-                 * a contradiction, which can only happen if the subPuzzle
-                 * is unsolvable for our maximum depth. We can learn nothing
-                 * from this result. */
-                grid_->setUpdated(false);
+    int ruleCountsBefore = ruleCounts_;
+    if (caching) {
+        grid_->markClosureChecks();
+    }
+
+    startBudget();
+    if (pe.h) {
+        makeHLineGuess(pe.coords.i, pe.coords.j, depth);
+    } else {
+        makeVLineGuess(pe.coords.i, pe.coords.j, depth);
+    }
+    bool cutShort = endBudget();
+
+    if (!caching || cutShort || grid_->getUpdated() || multipleSolutions_ || footprint_.empty() || grid_->hasPendingClosure()) {
+        return;
+    }
+
+    if (fitsWindow(footprint_)) {
+        radius = INT_MAX;
+    }
+
+    /* a contour that is a line from closing may only be closed if it
+     * is the only one, so a guess that came to one holds only while
+     * there are as many other contours to spare */
+    int fewest = grid_->getFewestLoopsChecked();
+    int minOpenLoops = fewest == INT_MAX ? INT_MIN : grid_->getOpenLoops() - (fewest - 2);
+    probes_->store(pe.coords.i, pe.coords.j, pe.h, radius, footprint_, minOpenLoops, ruleCounts_ - ruleCountsBefore);
+}
+
+/* Guesses the edges near the ends of contours before the sweep of
+ * solveDepth gets to the rest, as docs/guess-algorithm.txt has it:
+ * first the empty edges of the EPQ within the guess radius of an end,
+ * nearest first, then, if none of them learned anything, those within
+ * twice the radius, and so on for as long as the radius is short of
+ * spanning the grid. The rules of each guess are applied only within
+ * the radius of the edge guessed, so that each guess costs as much as
+ * the window it is kept to rather than the whole grid; what follows
+ * from further away is left to the wider guesses. Gives whether any
+ * guess changed the grid or found more than one solution. */
+bool Solver::guessLocally() {
+    std::vector<int> distances;
+    if (!distancesToEnds(distances)) {
+        return false;
+    }
+
+    int stride = grid_->getWidth() + 1;
+    int span = grid_->getHeight() + grid_->getWidth();
+    std::vector<PrioEdge> queued = epq_.copyPQToVector();
+    std::vector<std::pair<int, int> > near;
+    for (int radius = options_.guessRadius; radius < span && !cancelled(); radius *= 2) {
+        near.clear();
+        for (int k = 0; k < queued.size(); k++) {
+            PrioEdge const & pe = queued[k];
+            int p = pe.coords.i * stride + pe.coords.j;
+            int d = std::min(distances[p], distances[pe.h ? p+1 : p+stride]);
+            if (d <= radius && getLine(pe.coords.i, pe.coords.j, pe.h) == EMPTY) {
+                near.push_back(std::make_pair(d, 2*p + !pe.h));
             }
-            return;
         }
-        /* test for contradictions; if we encounter one we set the opposite line */
-        else if (lineSolver.testContradictions()) {
-            grid_->setHLine(i, j, NLINE);
-            return;
-        } else {
-            Grid nLineGuess;
-            grid_->copy(nLineGuess);
-
-            /* make an NLINE guess */
-            nLineGuess.setHLine(i, j, NLINE);
-            Solver nLineSolver = Solver(nLineGuess, rules_, contradictions_, selectedRules_, selectLength_, depth, epq_);
-            ruleCounts_ = ruleCounts_ + nLineSolver.ruleCounts_;
-
-            /* if both guesses led to multiple solutions, we know this puzzle
-             * must also lead to another solution */
-            if (nLineSolver.hasMultipleSolutions() || lineSolver.hasMultipleSolutions()) {
-                multipleSolutions_ = true;
-                return;
+        std::sort(near.begin(), near.end());
+
+        windowRadius_ = radius;
+        for (int k = 0; k < near.size() && !cancelled(); k++) {
+            int p = near[k].second / 2;
+            PrioEdge pe = PrioEdge { Coordinates { p / stride, p % stride }, 0, !(near[k].second & 1) };
+            windowCenter_ = pe.coords;
+            probeEdge(pe, 0);
+            if (grid_->getUpdated() || multipleSolutions_) {
+                windowRadius_ = -1;
+                return true;
             }
-            /* again check if solved. In this case we already know that we can't
-             * get to a solution or contradiction with the opposite guess, so
-             * we know we can't conclude whether this is the single solution */
-            else if (nLineGuess.isSolved()) {
-                lineSolver = Solver(lineGuess, rules_, contradictions_, selectedRules_, selectLength_, MAX_DEPTH, epq_);
-                ruleCounts_ = ruleCounts_ + lineSolver.ruleCounts_;
-                if (lineSolver.testContradictions()) {
-                    /* The opposite guess leads to a contradiction
-                     * so the previous found solution is the only one */
-                    nLineGuess.copy(*grid_);
-                } else if (lineGuess.isSolved() || lineSolver.hasMultipleSolutions()) {
-                    /* The opposite guess also led to a solution
-                     * so there are multiple solutions */
-                    multipleSolutions_ = true;
-                } else {
-                    /* The opposite guess led to neither a solution or
-                     * a contradiction, which can only happen if the subPuzzle
-                     * is unsolvable for our maximum depth. We can learn nothing
-                     * from this result. */
-                    grid_->setUpdated(false);
-                }
-                return;
+        }
+        windowRadius_ = -1;
+    }
+    return false;
+}
+
+/* Gives the distance from each point to the nearest end of a contour
+ * along the lattice, or false if there are no ends. Going over the
+ * points forwards and then backwards, each taking the nearest of its
+ * own distance and those of the points already gone over next to it,
+ * is enough for distances made of steps along the rows and columns. */
+bool Solver::distancesToEnds(std::vector<int> & distances) const {
+    int m = grid_->getHeight() + 1;
+    int n = grid_->getWidth() + 1;
+    bool ends = false;
+    distances.assign(m*n, m + n);
+    for (int i = 0; i < m; i++) {
+        for (int j = 0; j < n; j++) {
+            if (grid_->isContourEnd(i, j)) {
+                distances[i*n + j] = 0;
+                ends = true;
             }
-            /* again check for contradictions */
-            else if (nLineSolver.testContradictions()) {
-                grid_->setHLine(i, j, LINE);
-                return;
-            } else {
-                grid_->setUpdated(false);
+        }
+    }
+    if (!ends) {
+        return false;
+    }
+
+    for (int i = 0; i < m; i++) {
+        for (int j = 0; j < n; j++) {
+            int & d = distances[i*n + j];
+            d = std::min(d, std::min(i > 0 ? distances[(i-1)*n + j] + 1 : d, j > 0 ? distances[i*n + j-1] + 1 : d));
+        }
+    }
+    for (int i = m-1; i >= 0; i--) {
+        for (int j = n-1; j >= 0; j--) {
+            int & d = distances[i*n + j];
+            d = std::min(d, std::min(i < m-1 ? distances[(i+1)*n + j] + 1 : d, j < n-1 ? distances[i*n + j+1] + 1 : d));
+        }
+    }
+    return true;
+}
 
-                /* check for things that happen when we make both
-                 * guesses; if we find any, we know they must happen */
-                intersectGrids(lineGuess, nLineGuess);
+/* Tells whether a rule anchored at a given place may be applied by a
+ * local guess, which is when it is within the window of the guess */
+bool Solver::inWindow(int i, int j) const {
+    return windowRadius_ < 0 || (std::abs(i - windowCenter_.i) <= windowRadius_ && std::abs(j - windowCenter_.j) <= windowRadius_);
+}
 
-                if (grid_->getUpdated()) {
-                    return;
-                }
+/* Tells whether a local guess that touched the given points could
+ * have applied every rule that a guess without a window would have.
+ * A rule is anchored no further from the edge that wakes it than the
+ * reach of the patterns, so that is when every point touched is at
+ * least as far as that inside the window. */
+bool Solver::fitsWindow(std::vector<Coordinates> const & points) const {
+    if (windowRadius_ < 0) {
+        return true;
+    }
+    int inside = windowRadius_ - patterns_->getReach();
+    for (int k = 0; k < points.size(); k++) {
+        if (std::abs(points[k].i - windowCenter_.i) > inside || std::abs(points[k].j - windowCenter_.j) > inside) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Does the work of solveDepth with the edges that the sweep would
+ * probe next, had none of them changed the grid, forked as tasks for
+ * the workers of the pool, each on its own copy of the grid and with
+ * the EPQ as it would have been at that point. Any probe that no
+ * worker has stolen by the time the sweep comes to it is made right
+ * away on this thread. The results are replayed onto the grid in the
+ * order of the sweep, which stops at the first one that changed the
+ * grid just as it would have without threads, so the outcome never
+ * depends on timing; the probes after it are then cancelled. Solvers
+ * at every depth sweep this way, so the whole tree of guesses is open
+ * to idle workers. Guesses of depth 0 are too small to be worth a
+ * task, and are made in place. */
+void Solver::solveDepthParallel(int depth) {
+    int initSize = epq_.size();
+    int guesses = 0;
+
+    std::vector<PlannedProbe> plan;
+    std::vector<ProbeResult> results;
+    int next = 0;
+
+    while (!epq_.empty() && guesses++ < initSize && !multipleSolutions_ && !cancelled()) {
+        if (next == plan.size()) {
+            planProbes(initSize - guesses + 1, plan);
+            startProbes(plan, depth, results);
+            next = 0;
+        }
+
+        PrioEdge pe = epq_.top();
+        assert(plan[next].pe.coords.i == pe.coords.i && plan[next].pe.coords.j == pe.coords.j && plan[next].pe.h == pe.h);
+
+        if (plan[next].probed) {
+            ProbeResult & result = results[next];
+            finishProbe(result);
+            grid_->applyAssignments(result.assignments);
+            grid_->setUpdated(result.updated);
+            multipleSolutions_ = multipleSolutions_ || result.multipleSolutions;
+            ruleCounts_ = ruleCounts_ + result.ruleCounts;
+            learned_.insert(learned_.end(), result.learned.begin(), result.learned.end());
+        }
+        next++;
+
+        if (getLine(pe.coords.i, pe.coords.j, pe.h) != EMPTY) {
+            epq_.pop();
+        } else if (!grid_->getUpdated()) {
+            epq_.lower(pe);
+        }
+        if (grid_->getUpdated()) {
+            if (heuristic_ && heuristic_->usesActivity()) {
+                epq_.reward(pe);
             }
+            break;
+        }
+    }
+
+    discardProbes(results, next);
+}
+
+/* Lists the edges that the sweep of solveDepth would come to over
+ * the next maxSteps steps if no guess changed the grid, stopping once
+ * there is one edge to probe for each worker of the pool. */
+void Solver::planProbes(int maxSteps, std::vector<PlannedProbe> & plan) const {
+    EPQ epq = epq_;
+    int probes = 0;
+
+    plan.clear();
+    for (int step = 0; step < maxSteps && !epq.empty() && probes < pool_->getThreads(); step++) {
+        PrioEdge pe = epq.top();
+        if (getLine(pe.coords.i, pe.coords.j, pe.h) == EMPTY) {
+            plan.push_back(PlannedProbe { pe, true, epq });
+            probes++;
+            epq.lower(pe);
+        } else {
+            plan.push_back(PlannedProbe { pe, false, EPQ() });
+            epq.pop();
         }
     }
 }
 
+/* Forks a task for each planned probe, in the order of the sweep so
+ * that thieves take the probes that are most likely to be needed.
+ * The grid is copied for each probe before any of them start, since
+ * the grid changes as soon as the first of them is replayed. */
+void Solver::startProbes(std::vector<PlannedProbe> const & plan, int depth, std::vector<ProbeResult> & results) {
+    int worker = pool_->getWorker();
+
+    results.clear();
+    results.resize(plan.size());
+    for (int k = 0; k < plan.size(); k++) {
+        if (!plan[k].probed) {
+            continue;
+        }
+
+        ProbeResult & result = results[k];
+        result.updated = false;
+        result.multipleSolutions = false;
+        result.ruleCounts = 0;
+        result.grid = arena_->acquire(worker);
+        grid_->copy(*result.grid);
+        result.cancel.reset(new CancelToken(cancel_));
+
+        PlannedProbe const * planned = &plan[k];
+        ProbeResult * out = &result;
+        pool_->fork(result.task, [this, planned, depth, out] {
+            probe(*planned, depth, *out);
+        });
+    }
+}
+
+/* Waits for a probe to have been made, making it here if no worker
+ * has taken it */
+void Solver::finishProbe(ProbeResult & result) {
+    pool_->join(result.task);
+    arena_->release(pool_->getWorker(), result.grid);
+}
+
+/* Cancels the probes from the given one on, which the sweep stopped
+ * before getting to */
+void Solver::discardProbes(std::vector<ProbeResult> & results, int from) {
+    for (int k = from; k < results.size(); k++) {
+        if (results[k].cancel) {
+            results[k].cancel->cancel();
+        }
+    }
+    for (int k = from; k < results.size(); k++) {
+        if (results[k].cancel) {
+            pool_->discard(results[k].task);
+            arena_->release(pool_->getWorker(), results[k].grid);
+        }
+    }
+}
+
+/* Makes the guess of a probe on its copy of the grid with a solver of
+ * its own, from the scratch of the worker, recording what the guess
+ * did to the grid */
+void Solver::probe(PlannedProbe const & planned, int depth, ProbeResult & result) const {
+    Grid & scratch = *result.grid;
+    int worker = pool_->getWorker();
+    GuessScratch * guess = guessArena_->acquire(worker);
+    Solver & prober = spawn(guess->lineSolver, scratch);
+    prober.epq_ = planned.epq;
+    prober.cancel_ = result.cancel.get();
+    if (!prober.cancelled()) {
+        scratch.pushCheckpoint();
+        prober.startBudget();
+        prober.makeGuess(planned.pe.coords.i, planned.pe.coords.j, planned.pe.h, depth);
+        prober.endBudget();
+        scratch.getAssignments(result.assignments);
+        result.updated = scratch.getUpdated();
+        result.multipleSolutions = prober.multipleSolutions_;
+        result.ruleCounts = prober.ruleCounts_;
+        result.learned.swap(prober.learned_);
+        scratch.rollback();
+    }
+    prober.epq_.clear();
+    guessArena_->release(worker, guess);
+}
+
+/* Gives a guess of the solver that started the tree a budget of its
+ * own, if the options limit what one may spend */
+void Solver::startBudget() {
+    if (!nested_ && (options_.ruleBudget > 0 || options_.guessBudget > 0 || options_.timeBudget > 0)) {
+        budget_ = std::make_shared<ProbeBudget>(options_);
+    }
+}
+
+/* Gives whether the guess just made ran out of budget. For the solver
+ * that started the tree, the budget ends with the guess, which counts
+ * as inconclusive if it ran out before learning anything. Whatever a
+ * guess did learn before then stands, as it follows from the solutions
+ * and contradictions the guess found. */
+bool Solver::endBudget() {
+    bool spent = overBudget();
+    if (!nested_ && budget_) {
+        if (spent && !grid_->getUpdated() && !multipleSolutions_) {
+            (*inconclusive_)++;
+        }
+        budget_.reset();
+    }
+    return spent;
+}
+
+/* Horizontal guess at the given location to the given depth */
+void Solver::makeHLineGuess(int i, int j, int depth) {
+    assert(0 <= i && i < grid_->getHeight()+1 && 0 <= j && j < grid_->getWidth());
+    assert(depth >= 0);
+
+    if (grid_->getHLine(i, j) == EMPTY) {
+        makeGuess(i, j, true, depth);
+    }
+}
+
 /* Vertical guess at the given location to the given depth */
 void Solver::makeVLineGuess(int i, int j, int depth) {
     assert(0 <= i && i < grid_->getHeight() && 0 <= j && j < grid_->getWidth()+1);
     assert(depth >= 0);
 
     if (grid_->getVLine(i, j) == EMPTY) {
-        /* there is only one case where the grid
-         * will not be updated, which is handled
-         * at the end of this iteration. */
-        grid_->setUpdated(true);
-
-        Grid lineGuess;
-        grid_->copy(lineGuess);
-
-        /* make a LINE guess */
-        lineGuess.setVLine(i, j, LINE);
-        Solver lineSolver = Solver(lineGuess, rules_, contradictions_, selectedRules_, selectLength_, depth, epq_);
-        ruleCounts_ = ruleCounts_ + lineSolver.ruleCounts_;
-
-        /* If this guess happens to solve the puzzle we need to make sure that
-         * the opposite guess leads to a contradiction, otherwise we know that
-         * there might be multiple solutions */
-        if (lineGuess.isSolved()) {
-            Grid nLineGuess;
-            grid_->copy(nLineGuess);
-            nLineGuess.setVLine(i, j, NLINE);
-            Solver nLineSolver = Solver(nLineGuess, rules_, contradictions_, selectedRules_, selectLength_, MAX_DEPTH, epq_);
-            ruleCounts_ = ruleCounts_ + nLineSolver.ruleCounts_;
-            if (nLineSolver.testContradictions()) {
-                /* The opposite guess leads to a contradiction
-                 * so the previous found solution is the only one */
-                lineGuess.copy(*grid_);
-            } else if (nLineGuess.isSolved() || nLineSolver.hasMultipleSolutions()) {
-                /* The opposite guess also led to a solution
-                 * so there are multiple solutions */
-                multipleSolutions_ = true;
-            } else {
-                /* The opposite guess led to neither a solution or
-                 * a contradiction, which can only happen if the subPuzzle
-                 * is unsolvable for our maximum depth. We can learn nothing
-                 * from this result. */
-                grid_->setUpdated(false);
-            }
-            return;
+        makeGuess(i, j, false, depth);
+    }
+}
+
+/* Gets the value of a horizontal or vertical edge on a grid */
+static Edge lineOf(Grid const & grid, int i, int j, bool hline) {
+    return hline ? grid.getHLine(i, j) : grid.getVLine(i, j);
+}
+
+/* Sets the value of a horizontal or vertical edge on a grid */
+static void setLineOf(Grid & grid, int i, int j, bool hline, Edge edge) {
+    if (hline) {
+        grid.setHLine(i, j, edge);
+    } else {
+        grid.setVLine(i, j, edge);
+    }
+}
+
+/* Guesses both values for an empty edge to the given depth. Each guess
+ * is made on the grid itself behind a checkpoint and rolled back once
+ * it has been inspected; the deductions it made are kept as a list of
+ * assignments so that they can be replayed or intersected later.
+ * With threads to spare, the NLINE guess is made on a scratch grid
+ * alongside the LINE guess instead. It is cancelled whenever the LINE
+ * guess turns out to make it unnecessary, and otherwise used just as
+ * it would have been had it been made afterwards, so the outcome is
+ * the same either way. A guess that ends in a contradiction is learned
+ * from, and the nogoods learned by the solver of either guess are
+ * passed on whenever that guess is used.
+ * The solvers of the two guesses and the lists they fill in come from
+ * scratch taken from the arena for the guess, and go back once it is
+ * done. */
+void Solver::makeGuess(int i, int j, bool hline, int depth) {
+    int worker = pool_ ? pool_->getWorker() : 0;
+    GuessScratch * scratch = guessArena_->acquire(worker);
+    makeGuess(i, j, hline, depth, *scratch);
+
+    /* the solvers of the guess let go of the heap of the EPQ, which
+     * this solver would otherwise have to copy to change it */
+    if (scratch->lineSolver) {
+        scratch->lineSolver->epq_.clear();
+    }
+    if (scratch->nLineSolver) {
+        scratch->nLineSolver->epq_.clear();
+    }
+    guessArena_->release(worker, scratch);
+}
+
+/* Does the work of makeGuess with the scratch given */
+void Solver::makeGuess(int i, int j, bool hline, int depth, GuessScratch & scratch) {
+    (*guesses_)++;
+    if (budget_) {
+        budget_->spendGuess();
+    }
+
+    /* there is only one case where the grid
+     * will not be updated, which is handled
+     * at the end of this iteration. */
+    grid_->setUpdated(true);
+
+    std::vector<EdgeAssignment> & lineDeductions = scratch.lineDeductions;
+    std::vector<EdgeAssignment> & nLineDeductions = scratch.nLineDeductions;
+    std::vector<Coordinates> & lineTouched = scratch.lineTouched;
+    lineTouched.clear();
+    bool tracking = depth == 0 && probes_;
+    footprint_.clear();
+
+    Branch nLine;
+    startBranch(scratch, nLine, i, j, hline, NLINE, depth);
+
+    /* make a LINE guess */
+    grid_->pushCheckpoint();
+    setLine(i, j, hline, LINE);
+    Solver & lineSolver = spawn(scratch.lineSolver, *grid_);
+    lineSolver.startGuess(depth);
+    ruleCounts_ = ruleCounts_ + lineSolver.ruleCounts_;
+    bool lineSolved = grid_->isSolved();
+    bool lineContradiction = !lineSolved && lineSolver.testContradictions();
+    grid_->getAssignments(lineDeductions);
+    if (tracking && !lineSolved && !lineContradiction && grid_->getFewestLoopsChecked() >= 2) {
+        grid_->getTouchedPoints(lineTouched);
+        addNogoodPoints(lineDeductions, lineTouched);
+    }
+    absorbNogoods(lineSolver);
+    if (lineContradiction) {
+        learnFrom(lineSolver);
+    }
+    grid_->rollback();
+
+    /* If this guess happens to solve the puzzle we need to make sure that
+     * the opposite guess leads to a contradiction, otherwise we know that
+     * there might be multiple solutions */
+    if (lineSolved) {
+        finishBranch(scratch, nLine, i, j, hline, NLINE, MAX_DEPTH);
+        ruleCounts_ = ruleCounts_ + nLine.solver->ruleCounts_;
+        absorbNogoods(*nLine.solver);
+        bool nLineContradiction = nLine.solver->testContradictions();
+        bool nLineSolved = nLine.grid->isSolved() || nLine.solver->hasMultipleSolutions();
+        if (nLineContradiction) {
+            learnFrom(*nLine.solver);
         }
-        /* test for contradictions; if we encounter one we set the opposite line */
-        else if (lineSolver.testContradictions()) {
-            grid_->setVLine(i, j, NLINE);
-            return;
+        endBranch(nLine);
+
+        if (nLineContradiction) {
+            /* The opposite guess leads to a contradiction
+             * so the previous found solution is the only one */
+            grid_->applyAssignments(lineDeductions);
+        } else if (nLineSolved) {
+            /* The opposite guess also led to a solution
+             * so there are multiple solutions */
+            multipleSolutions_ = true;
         } else {
-            Grid nLineGuess;
-            grid_->copy(nLineGuess);
-
-            /* make an NLINE guess */
-            nLineGuess.setVLine(i, j, NLINE);
-            Solver nLineSolver = Solver(nLineGuess, rules_, contradictions_, selectedRules_, selectLength_, depth, epq_);
-            ruleCounts_ = ruleCounts_ + nLineSolver.ruleCounts_;
-
-            /* if both guesses led to multiple solutions, we know this puzzle
-             * must also lead to another solution */
-            if (nLineSolver.hasMultipleSolutions() || lineSolver.hasMultipleSolutions()) {
-                multipleSolutions_ = true;
-                return;
-            }
-            /* again check if solved. In this case we already know that we can't
-             * get to a solution or contradiction with the opposite guess, so
-             * we know we can't conclude whether this is the single solution */
-            else if (nLineGuess.isSolved()) {
-                lineSolver = Solver(lineGuess, rules_, contradictions_, selectedRules_, selectLength_, MAX_DEPTH, epq_);
-                ruleCounts_ = ruleCounts_ + lineSolver.ruleCounts_;
-                if (lineSolver.testContradictions()) {
-                    /* The opposite guess leads to a contradiction
-                     * so the previous found solution is the only one */
-                    nLineGuess.copy(*grid_);
-                } else if (lineGuess.isSolved() || lineSolver.hasMultipleSolutions()) {
-                    /* The opposite guess also led to a solution
-                     * so there are multiple solutions */
-                    multipleSolutions_ = true;
-                } else {
-                    /* The opposite guess led to neither a solution or
-                     * a contradiction, which can only happen if the subPuzzle
-                     * is unsolvable for our maximum depth. We can learn nothing
-                     * from this result. */
-                    grid_->setUpdated(false);
-                }
-                return;
-            }
-            /* again check for contradictions */
-            else if (nLineSolver.testContradictions()) {
-                grid_->setVLine(i, j, LINE);
-                return;
-            } else {
-                grid_->setUpdated(false);
+            /* The opposite guess led to neither a solution or
+             * a contradiction, which can only happen if the subPuzzle
+             * is unsolvable for our maximum depth. We can learn nothing
+             * from this result. */
+            grid_->setUpdated(false);
+        }
+        return;
+    }
+    /* test for contradictions; if we encounter one we set the opposite line */
+    else if (lineContradiction) {
+        cancelBranch(nLine);
+        setLine(i, j, hline, NLINE);
+        return;
+    }
+    /* if the LINE guess led to multiple solutions, we know this puzzle
+     * must also lead to another solution whatever the NLINE guess does */
+    else if (lineSolver.hasMultipleSolutions()) {
+        cancelBranch(nLine);
+        multipleSolutions_ = true;
+        return;
+    }
 
-                /* check for things that happen when we make both
-                 * guesses; if we find any, we know they must happen */
-                intersectGrids(lineGuess, nLineGuess);
+    /* make an NLINE guess */
+    finishBranch(scratch, nLine, i, j, hline, NLINE, depth);
+    ruleCounts_ = ruleCounts_ + nLine.solver->ruleCounts_;
+    absorbNogoods(*nLine.solver);
 
-                if (grid_->getUpdated()) {
-                    return;
-                }
-            }
+    if (nLine.solver->hasMultipleSolutions()) {
+        endBranch(nLine);
+        multipleSolutions_ = true;
+        return;
+    }
+    /* again check if solved. In this case we already know that we can't
+     * get to a solution or contradiction with the opposite guess, so
+     * we know we can't conclude whether this is the single solution */
+    else if (nLine.grid->isSolved()) {
+        nLine.grid->getAssignments(nLineDeductions);
+        endBranch(nLine);
+
+        /* pick the LINE guess back up where it left off */
+        grid_->pushCheckpoint();
+        grid_->applyAssignments(lineDeductions);
+        Solver & deepLineSolver = spawn(scratch.lineSolver, *grid_);
+        deepLineSolver.startGuess(MAX_DEPTH);
+        ruleCounts_ = ruleCounts_ + deepLineSolver.ruleCounts_;
+        bool deepLineContradiction = deepLineSolver.testContradictions();
+        bool deepLineSolved = grid_->isSolved() || deepLineSolver.hasMultipleSolutions();
+        absorbNogoods(deepLineSolver);
+        if (deepLineContradiction) {
+            learnFrom(deepLineSolver);
         }
+        grid_->rollback();
+
+        if (deepLineContradiction) {
+            /* The opposite guess leads to a contradiction
+             * so the previous found solution is the only one */
+            grid_->applyAssignments(nLineDeductions);
+        } else if (deepLineSolved) {
+            /* The opposite guess also led to a solution
+             * so there are multiple solutions */
+            multipleSolutions_ = true;
+        } else {
+            /* The opposite guess led to neither a solution or
+             * a contradiction, which can only happen if the subPuzzle
+             * is unsolvable for our maximum depth. We can learn nothing
+             * from this result. */
+            grid_->setUpdated(false);
+        }
+        return;
+    }
+    /* again check for contradictions; if we encounter one, everything
+     * the LINE guess led to must happen */
+    else if (nLine.solver->testContradictions()) {
+        learnFrom(*nLine.solver);
+        endBranch(nLine);
+        grid_->applyAssignments(lineDeductions);
+        return;
     }
+
+    /* check for things that happen when we make both
+     * guesses; if we find any, we know they must happen */
+    if (!lineTouched.empty() && nLine.grid->getFewestLoopsChecked() >= 2) {
+        footprint_.swap(lineTouched);
+        nLine.grid->getTouchedPoints(footprint_);
+        std::vector<EdgeAssignment> & nLineAssignments = scratch.nLineAssignments;
+        nLine.grid->getAssignments(nLineAssignments);
+        addNogoodPoints(nLineAssignments, footprint_);
+    }
+    std::vector<EdgeAssignment> & common = scratch.common;
+    common.clear();
+    for (int k = 0; k < lineDeductions.size(); k++) {
+        EdgeAssignment const & a = lineDeductions[k];
+        if (lineOf(*nLine.grid, a.coords.i, a.coords.j, a.h) == a.edge) {
+            common.push_back(a);
+        }
+    }
+    endBranch(nLine);
+
+    grid_->setUpdated(false);
+    intersectGrids(common);
 }
 
-/* Checks for the intersection between lineGuess and nLineGuess grids
- * and applies any intersection to the canonical grid. */
-void Solver::intersectGrids(Grid const & lineGuess, Grid const & nLineGuess) {
-    assert(lineGuess.getHeight() == nLineGuess.getHeight() &&
-           lineGuess.getWidth() == nLineGuess.getWidth());
+/* Starts guessing a value for an edge on a scratch grid in the
+ * background, if the guess is deep enough to be worth it and there
+ * are threads to spare. Otherwise the guess is left for finishBranch
+ * to make on the grid itself. */
+void Solver::startBranch(GuessScratch & scratch, Branch & branch, int i, int j, bool hline, Edge edge, int depth) {
+    branch.speculative = pool_ && depth > 0;
+    branch.solver = NULL;
+    if (!branch.speculative) {
+        branch.grid = grid_;
+        return;
+    }
 
-    for (int i = 0; i < grid_->getHeight()+1; i++) {
-        for (int j = 0; j < grid_->getWidth(); j++) {
-            if (lineGuess.getHLine(i, j) == nLineGuess.getHLine(i, j) &&
-                  lineGuess.getHLine(i, j) != grid_->getHLine(i, j)) {
-                grid_->setHLine(i, j, lineGuess.getHLine(i, j));
-                grid_->setUpdated(true);
-            }
+    branch.grid = arena_->acquire(pool_->getWorker());
+    grid_->copy(*branch.grid);
+    branch.cancel.reset(new CancelToken(cancel_));
+    branch.solver = &spawn(scratch.nLineSolver, *branch.grid);
+    branch.solver->depth_ = depth;
+    branch.solver->nested_ = true;
+    branch.solver->cancel_ = branch.cancel.get();
+
+    Solver * solver = branch.solver;
+    pool_->fork(branch.task, [solver, i, j, hline, edge] {
+        solver->grid_->pushCheckpoint();
+        solver->setLine(i, j, hline, edge);
+        solver->solveGuess();
+    });
+}
+
+/* Waits for a guess to have been made to the given depth */
+void Solver::finishBranch(GuessScratch & scratch, Branch & branch, int i, int j, bool hline, Edge edge, int depth) {
+    if (!branch.speculative) {
+        grid_->pushCheckpoint();
+        setLine(i, j, hline, edge);
+        branch.solver = &spawn(scratch.nLineSolver, *grid_);
+        branch.solver->startGuess(depth);
+        return;
+    }
+
+    pool_->join(branch.task);
+    if (depth <= branch.solver->depth_) {
+        return;
+    }
+
+    /* a solver that replayed the table has nothing to carry on from,
+     * so the guess is made again from scratch at the greater depth */
+    if (branch.solver->fromTable_) {
+        branch.grid->rollback();
+        branch.grid->pushCheckpoint();
+        setLineOf(*branch.grid, i, j, hline, edge);
+        branch.solver = &spawn(scratch.nLineSolver, *branch.grid);
+        branch.solver->startGuess(depth);
+    } else {
+        branch.solver->deepen(depth);
+    }
+}
+
+/* Abandons a guess whose result will not be needed */
+void Solver::cancelBranch(Branch & branch) {
+    if (!branch.speculative) {
+        return;
+    }
+
+    /* a guess that no worker got to has nothing to undo */
+    branch.cancel->cancel();
+    pool_->discard(branch.task);
+    if (branch.grid->getCheckpointDepth() > 0) {
+        branch.grid->rollback();
+    }
+    branch.solver = NULL;
+    arena_->release(pool_->getWorker(), branch.grid);
+}
+
+/* Undoes a guess once it has been inspected */
+void Solver::endBranch(Branch & branch) {
+    branch.grid->rollback();
+    if (branch.speculative) {
+        branch.solver = NULL;
+        arena_->release(pool_->getWorker(), branch.grid);
+    }
+}
+
+/* Applies the deductions that both guesses for an edge made to the
+ * canonical grid. */
+void Solver::intersectGrids(std::vector<EdgeAssignment> const & common) {
+    for (int k = 0; k < common.size(); k++) {
+        EdgeAssignment const & a = common[k];
+        if (getLine(a.coords.i, a.coords.j, a.h) != a.edge) {
+            setLine(a.coords.i, a.coords.j, a.h, a.edge);
+            grid_->setUpdated(true);
         }
     }
+}
+
+/* Gets the value of a horizontal or vertical edge on the grid */
+Edge Solver::getLine(int i, int j, bool hline) const {
+    return lineOf(*grid_, i, j, hline);
+}
+
+/* Sets the value of a horizontal or vertical edge on the grid */
+void Solver::setLine(int i, int j, bool hline, Edge edge) {
+    setLineOf(*grid_, i, j, hline, edge);
+}
+
+/* Applies the nogoods to the edges set since they were last applied,
+ * giving whether they set any edge */
+bool Solver::propagateNogoods() {
+    if (!watches_) {
+        grid_->discardChanges(CLAUSE_QUEUE);
+        return false;
+    }
+    return watches_->propagate(*grid_);
+}
+
+/* Tells whether deductions that reach across the whole grid may be
+ * made. A guess of depth 0 leaves them alone, since the probe cache
+ * counts on such a guess seeing only as far as the rules do; the edges
+ * it sets stay queued in case it is made deeper. */
+bool Solver::seesWholeGrid() const {
+    return !nested_ || depth_ > 0;
+}
+
+/* Relates the colors of the cells by the edges set since they were
+ * last related, giving whether that set any edge */
+bool Solver::propagateColors() {
+    if (!coloring_) {
+        grid_->discardChanges(COLOR_QUEUE);
+        return false;
+    } else if (!seesWholeGrid()) {
+        return false;
+    }
+    return coloring_->propagate(*grid_);
+}
+
+/* Splits the edges into blocks again if any were set since they were
+ * last split, giving whether that ruled out any edge */
+bool Solver::propagateConnectivity() {
+    if (!connectivity_) {
+        grid_->discardChanges(CONNECTIVITY_QUEUE);
+        return false;
+    } else if (!seesWholeGrid()) {
+        return false;
+    }
+    return connectivity_->propagate(*grid_);
+}
+
+/* Checks whether an edge that the nogoods have not been applied to
+ * yet leaves all the literals of a nogood holding */
+bool Solver::breaksNogood() const {
+    if (!clauses_) {
+        return false;
+    }
 
-    for (int i = 0; i < grid_->getHeight(); i++) {
-        for (int j = 0; j < grid_->getWidth()+1; j++) {
-            if (lineGuess.getVLine(i, j) == nLineGuess.getVLine(i, j) &&
-                  lineGuess.getVLine(i, j) != grid_->getVLine(i, j)) {
-                grid_->setVLine(i, j, lineGuess.getVLine(i, j));
-                grid_->setUpdated(true);
+    std::vector<EdgeAssignment> pending;
+    grid_->getPendingChanges(CLAUSE_QUEUE, pending);
+    for (int k = 0; k < pending.size(); k++) {
+        std::vector<int> const & occurrences = clauses_->getOccurrences(clauses_->literalOf(pending[k]));
+        for (int x = 0; x < occurrences.size(); x++) {
+            int c = occurrences[x];
+            int const * l = clauses_->begin(c);
+            while (l != clauses_->end(c) && clauses_->holds(*grid_, *l)) {
+                l++;
+            }
+            if (l == clauses_->end(c)) {
+                return true;
             }
         }
     }
+    return false;
 }
 
-/* Runs a loop checking each rule in each orientation in each valid
- * position on the grid, checking if the rule applies, and, if so,
- * applying it, and continue updating them until there are no longer
- * any changes being made. */
-void Solver::applyRules(int selectedRules[]) {
-    while (grid_->getUpdated()) {
-        grid_->setUpdated(false);
-        for (int i = 0; i < grid_->getHeight(); i++) {
-            for (int j = 0; j < grid_->getWidth(); j++) {
-                if (grid_->getUpdateMatrix(i, j)) {
-                    for (int x = 0; x < selectLength_; x++) {
-                        for (Orientation orient : (Orientation[]){ UP, DOWN, LEFT, RIGHT, UPFLIP, DOWNFLIP, LEFTFLIP, RIGHTFLIP }) {
-                            if (ruleApplies(i, j, rules_[selectedRules[x]], orient)) {
-                                applyRule(i, j, rules_[selectedRules[x]], orient);
-                            }
-                        }
-                    }
-                }
-                grid_->setUpdateMatrix(i, j, false);
+/* Adds the nogoods learned since the last sweep to the database, for
+ * every solver of the tree to use from then on. Only the solver that
+ * started the tree does this, between sweeps, when no other solver is
+ * running and the grid holds nothing but facts. A nogood is cut down
+ * to the literals whose edges are still empty, and dropped if one of
+ * its edges is set the other way or too many are left; the edge of a
+ * nogood left with a single literal is set right away. Probes near
+ * the edges of new nogoods are forgotten, since they could now learn
+ * something. Gives whether any edge was set. */
+bool Solver::publishNogoods() {
+    if (!clauses_ || nested_) {
+        return false;
+    }
+
+    bool changed = false;
+    for (int k = 0; k < learned_.size() && grid_->getValid(); k++) {
+        Nogood reduced;
+        bool satisfied = false;
+        for (int x = 0; x < learned_[k].size() && !satisfied; x++) {
+            EdgeAssignment a = clauses_->edgeOf(learned_[k][x]);
+            Edge edge = getLine(a.coords.i, a.coords.j, a.h);
+            if (edge == EMPTY) {
+                reduced.push_back(learned_[k][x]);
+            }
+            satisfied = edge != EMPTY && edge != a.edge;
+        }
+
+        if (satisfied || reduced.size() > MAX_NOGOOD) {
+            continue;
+        } else if (reduced.empty()) {
+            grid_->setValid(false);
+        } else if (reduced.size() == 1) {
+            EdgeAssignment a = clauses_->edgeOf(reduced[0]);
+            setLine(a.coords.i, a.coords.j, a.h, a.edge == LINE ? NLINE : LINE);
+            grid_->setUpdated(true);
+            changed = true;
+        } else if (clauses_->add(reduced) && probes_) {
+            for (int x = 0; x < reduced.size(); x++) {
+                probes_->touch(clauses_->edgeOf(reduced[x]));
             }
         }
     }
+    learned_.clear();
+
+    if (grid_->getValid()) {
+        changed = propagateNogoods() || changed;
+    }
+    clauses_->setFacts(*grid_);
+    return changed || !grid_->getValid();
 }
 
-/* Applies a rule in a given orientation to a given region of the
- * grid, overwriting all old values with any applicable values from
- * the after_ lattice for that rule. */
-void Solver::applyRule(int i, int j, Rule & rule, Orientation orient) {
-    int m = rule.getHeight();
-    int n = rule.getWidth();
-
-    std::vector<EdgePosition> const * hLineDiff = rule.getHLineDiff();
-    for (int k = 0; k < hLineDiff->size(); k++) {
-        EdgePosition pattern = (*hLineDiff)[k];
-        Coordinates adjusted = rotateHLine(pattern.coords.i, pattern.coords.j, m, n, orient);
-
-        switch (orient) {
-            case UPFLIP:
-            case UP:
-            case DOWNFLIP:
-            case DOWN:
-                if (grid_->getHLine(adjusted.i + i, adjusted.j + j) == EMPTY) {
-                    grid_->setValid(grid_->setHLine(adjusted.i + i, adjusted.j + j, pattern.edge));
-                    grid_->setUpdated(true);
-                }
-                break;
-            case LEFTFLIP:
-            case LEFT:
-            case RIGHTFLIP:
-            case RIGHT:
-                if (grid_->getVLine(adjusted.i + i, adjusted.j + j) == EMPTY) {
-                    grid_->setValid(grid_->setVLine(adjusted.i + i, adjusted.j + j, pattern.edge));
-                    grid_->setUpdated(true);
-                }
-                break;
-        }
+/* Takes on the nogoods learned by a solver spawned by this one */
+void Solver::absorbNogoods(Solver & child) {
+    learned_.insert(learned_.end(), child.learned_.begin(), child.learned_.end());
+    child.learned_.clear();
+}
+
+/* Learns a nogood from a guess that ended in a contradiction, while
+ * its grid still holds what the guess led to. The guesses made by a
+ * solver that is not nested are the only literals left of what it
+ * learns once the facts are dropped, and the guess itself is already
+ * known to be wrong, so it learns nothing. */
+void Solver::learnFrom(Solver const & branch) {
+    if (!clauses_ || !nested_) {
+        return;
     }
 
-    std::vector<EdgePosition> const * vLineDiff = rule.getVLineDiff();
-    for (int k = 0; k < vLineDiff->size(); k++) {
-        EdgePosition pattern = (*vLineDiff)[k];
-        Coordinates adjusted = rotateVLine(pattern.coords.i, pattern.coords.j, m, n, orient);
+    Nogood nogood;
+    if (branch.explainContradiction(nogood) && branch.resolveConflict(nogood)) {
+        learned_.push_back(nogood);
+    }
+}
 
-        switch (orient) {
-            case UPFLIP:
-            case UP:
-            case DOWNFLIP:
-            case DOWN:
-                if (grid_->getVLine(adjusted.i + i, adjusted.j + j) == EMPTY) {
-                    grid_->setValid(grid_->setVLine(adjusted.i + i, adjusted.j + j, pattern.edge));
-                    grid_->setUpdated(true);
-                }
-                break;
-            case LEFTFLIP:
-            case LEFT:
-            case RIGHTFLIP:
-            case RIGHT:
-                if (grid_->getHLine(adjusted.i + i, adjusted.j + j) == EMPTY) {
-                    grid_->setValid(grid_->setHLine(adjusted.i + i, adjusted.j + j, pattern.edge));
-                    grid_->setUpdated(true);
-                }
-                break;
-        }
+/* Adds the literal of an edge to a list if the edge lies on the grid
+ * and is set to the given value */
+static void addLiteralIf(Grid const & grid, ClauseDatabase const & clauses, int i, int j, bool hline, Edge edge, Nogood & literals) {
+    if (i < 0 || j < 0 || i > grid.getHeight() - !hline || j > grid.getWidth() - hline) {
+        return;
+    }
+    if (lineOf(grid, i, j, hline) == edge) {
+        literals.push_back(clauses.literalOf(i, j, hline, edge));
     }
 }
 
-/* Checks if a rule in a given orientation applies to a given
- * region of the grid by checking all non-empty values in the
- * before_ lattice and verifying they correspond to the values
- * in the grid. */
-bool Solver::ruleApplies(int i, int j, Rule const & rule, Orientation orient) const {
-    int m = rule.getHeight();
-    int n = rule.getWidth();
-    if (i > grid_->getHeight() - rule.getNumberHeight(orient)
-            || j > grid_->getWidth() - rule.getNumberWidth(orient)) {
+/* Explains a number that has more lines than it asks for, or too few
+ * edges left to get them, by the edges around it that make it so */
+static bool explainCell(Grid const & grid, ClauseDatabase const & clauses, int i, int j, Nogood & conflict) {
+    if (i < 0 || j < 0 || i >= grid.getHeight() || j >= grid.getWidth() || grid.getNumber(i, j) == NONE) {
         return false;
     }
 
-    std::vector<NumberPosition> const * numberPattern = rule.getNumberPattern();
-    for (int k = 0; k < numberPattern->size(); k++) {
-        NumberPosition pattern = (*numberPattern)[k];
-        Coordinates adjusted = rotateNumber(pattern.coords.i, pattern.coords.j, m, n, orient);
+    int value = grid.getNumber(i, j) - ZERO;
+    Edge edge = EMPTY;
+    if (grid.getLineCount(i, j) > value) {
+        edge = LINE;
+    } else if (4 - grid.getNLineCount(i, j) < value) {
+        edge = NLINE;
+    } else {
+        return false;
+    }
 
-        if (pattern.num != grid_->getNumber(adjusted.i + i, adjusted.j + j)) {
-            return false;
+    addLiteralIf(grid, clauses, i, j, true, edge, conflict);
+    addLiteralIf(grid, clauses, i+1, j, true, edge, conflict);
+    addLiteralIf(grid, clauses, i, j, false, edge, conflict);
+    addLiteralIf(grid, clauses, i, j+1, false, edge, conflict);
+    return true;
+}
+
+/* Explains a point that cannot be on a loop, because it has more than
+ * two lines or a single line and no edge left to continue it, by the
+ * edges around it that make it so */
+static bool explainPoint(Grid const & grid, ClauseDatabase const & clauses, int i, int j, Nogood & conflict) {
+    Nogood lines;
+    Nogood nLines;
+    addLiteralIf(grid, clauses, i, j-1, true, LINE, lines);
+    addLiteralIf(grid, clauses, i, j, true, LINE, lines);
+    addLiteralIf(grid, clauses, i-1, j, false, LINE, lines);
+    addLiteralIf(grid, clauses, i, j, false, LINE, lines);
+    addLiteralIf(grid, clauses, i, j-1, true, NLINE, nLines);
+    addLiteralIf(grid, clauses, i, j, true, NLINE, nLines);
+    addLiteralIf(grid, clauses, i-1, j, false, NLINE, nLines);
+    addLiteralIf(grid, clauses, i, j, false, NLINE, nLines);
+
+    int edges = (i > 0) + (i < grid.getHeight()) + (j > 0) + (j < grid.getWidth());
+    if (lines.size() > 2) {
+        conflict.insert(conflict.end(), lines.begin(), lines.end());
+        return true;
+    } else if (lines.size() == 1 && lines.size() + nLines.size() == edges) {
+        conflict.insert(conflict.end(), lines.begin(), lines.end());
+        conflict.insert(conflict.end(), nLines.begin(), nLines.end());
+        return true;
+    }
+    return false;
+}
+
+/* Finds literals that hold on the grid but cannot all hold at once,
+ * to explain why it is in contradiction: a broken nogood, a number or
+ * a point that cannot be satisfied, or a contradiction pattern. Each
+ * of these would have been found before the last guess was made if
+ * none of its edges had been set since, so only those edges are
+ * looked around. A loop closed too early depends on the whole loop
+ * and is not explained. */
+bool Solver::explainContradiction(Nogood & conflict) const {
+    std::vector<EdgeAssignment> recent;
+    grid_->getAssignments(recent);
+
+    for (int k = 0; k < recent.size(); k++) {
+        std::vector<int> const & occurrences = clauses_->getOccurrences(clauses_->literalOf(recent[k]));
+        for (int x = 0; x < occurrences.size(); x++) {
+            int c = occurrences[x];
+            int const * l = clauses_->begin(c);
+            while (l != clauses_->end(c) && clauses_->holds(*grid_, *l)) {
+                l++;
+            }
+            if (l == clauses_->end(c)) {
+                conflict.assign(clauses_->begin(c), clauses_->end(c));
+                return true;
+            }
         }
     }
 
-    std::vector<EdgePosition> const * hLinePattern = rule.getHLinePattern();
-    for (int k = 0; k < hLinePattern->size(); k++) {
-        EdgePosition pattern = (*hLinePattern)[k];
-        Coordinates adjusted = rotateHLine(pattern.coords.i, pattern.coords.j, m, n, orient);
+    for (int k = 0; k < recent.size(); k++) {
+        int i = recent[k].coords.i;
+        int j = recent[k].coords.j;
+        bool h = recent[k].h;
+        if (explainCell(*grid_, *clauses_, i - h, j - !h, conflict)
+                || explainCell(*grid_, *clauses_, i, j, conflict)
+                || explainPoint(*grid_, *clauses_, i, j, conflict)
+                || explainPoint(*grid_, *clauses_, i + !h, j + h, conflict)) {
+            return true;
+        }
+    }
 
-        switch (orient) {
-            case UPFLIP:
-            case UP:
-            case DOWNFLIP:
-            case DOWN:
-                if (pattern.edge != grid_->getHLine(adjusted.i + i, adjusted.j + j)) {
-                    return false;
-                }
-                break;
-            case LEFTFLIP:
-            case LEFT:
-            case RIGHTFLIP:
-            case RIGHT:
-                if (pattern.edge != grid_->getVLine(adjusted.i + i, adjusted.j + j)) {
-                    return false;
+    PatternElement const * elements = patterns_->getElements();
+    for (int k = 0; k < recent.size(); k++) {
+        EdgeAssignment const & change = recent[k];
+        PatternTrigger const * end = patterns_->contradictionTriggerEnd(change.h, change.edge);
+        for (PatternTrigger const * t = patterns_->contradictionTriggerBegin(change.h, change.edge); t != end; t++) {
+            CompiledPattern const & pattern = patterns_->getContradictionPattern(t->pattern);
+            int i = change.coords.i - t->di;
+            int j = change.coords.j - t->dj;
+            if (i < 0 || j < 0 || !contradictionApplies(i, j, pattern)) {
+                continue;
+            }
+            for (int e = pattern.checkStart; e < pattern.checkEnd; e++) {
+                if (elements[e].plane != NUMBER_CELLS) {
+                    conflict.push_back(clauses_->literalOf(i + elements[e].di, j + elements[e].dj, elements[e].plane == HLINE_CELLS, (Edge)elements[e].value));
                 }
-                break;
+            }
+            return true;
         }
     }
 
-    std::vector<EdgePosition> const * vLinePattern = rule.getVLinePattern();
-    for (int k = 0; k < vLinePattern->size(); k++) {
-        EdgePosition pattern = (*vLinePattern)[k];
-        Coordinates adjusted = rotateVLine(pattern.coords.i, pattern.coords.j, m, n, orient);
+    return false;
+}
 
-        switch (orient) {
-            case UPFLIP:
-            case UP:
-            case DOWNFLIP:
-            case DOWN:
-                if (pattern.edge != grid_->getVLine(adjusted.i + i, adjusted.j + j)) {
-                    return false;
-                }
-                break;
-            case LEFTFLIP:
-            case LEFT:
-            case RIGHTFLIP:
-            case RIGHT:
-                if (pattern.edge != grid_->getHLine(adjusted.i + i, adjusted.j + j)) {
-                    return false;
-                }
-                break;
+/* Replaces each literal of a conflict that follows from a rule or a
+ * nogood by the literals it follows from, until those left are facts,
+ * which are dropped, or edges set by anything else, such as a guess.
+ * No solution has all of the literals left, since the rules and the
+ * nogoods would lead from them to the conflict. Gives false, leaving
+ * the conflict unusable, if too many literals are left or one of them
+ * turns out not to hold. */
+bool Solver::resolveConflict(Nogood & nogood) const {
+    std::vector<int> pending;
+    pending.swap(nogood);
+    std::vector<char> seen(grid_->getEdgeCount(), false);
+
+    while (!pending.empty()) {
+        int literal = pending.back();
+        pending.pop_back();
+        int edge = literal / 2;
+        if (seen[edge] || clauses_->isFact(literal)) {
+            continue;
+        }
+        seen[edge] = true;
+        if (!clauses_->holds(*grid_, literal)) {
+            return false;
         }
-    }
 
+        int cause = grid_->getCause(edge);
+        if (cause == NO_CAUSE) {
+            nogood.push_back(literal);
+            if (nogood.size() > MAX_NOGOOD) {
+                return false;
+            }
+        } else {
+            addCauseLiterals(cause, edge, pending);
+        }
+    }
     return true;
 }
 
-/* Checks if a contradiction in a given orientation applies to
- * a given region of the grid by checking all non-empty values
- * in the before_ lattice and verifying they correspond to the
- * values in the grid. */
-bool Solver::contradictionApplies(int i, int j, Contradiction const & contradiction, Orientation orient) const {
-    int m = contradiction.getHeight();
-    int n = contradiction.getWidth();
+/* Adds the literals that an edge followed from: the edges that the
+ * rule in place checked for, or the other literals of the nogood */
+void Solver::addCauseLiterals(int cause, int edge, std::vector<int> & literals) const {
+    if (cause < NO_CAUSE) {
+        int c = ClauseDatabase::nogoodOf(cause);
+        for (int const * l = clauses_->begin(c); l != clauses_->end(c); l++) {
+            if (*l / 2 != edge) {
+                literals.push_back(*l);
+            }
+        }
+        return;
+    }
 
-    if (i > grid_->getHeight() - contradiction.getNumberHeight(orient)
-            || j > grid_->getWidth() - contradiction.getNumberWidth(orient)) {
-        return false;
+    int stride = grid_->getStride();
+    int area = (grid_->getHeight() + 1) * stride;
+    CompiledPattern const & pattern = patterns_->getRulePattern(cause / area);
+    int i = (cause % area) / stride;
+    int j = cause % stride;
+    PatternElement const * elements = patterns_->getElements();
+    for (int e = pattern.checkStart; e < pattern.checkEnd; e++) {
+        if (elements[e].plane != NUMBER_CELLS) {
+            literals.push_back(clauses_->literalOf(i + elements[e].di, j + elements[e].dj, elements[e].plane == HLINE_CELLS, (Edge)elements[e].value));
+        }
     }
+}
 
-    std::vector<NumberPosition> const * numberPattern = contradiction.getNumberPattern();
-    for (int k = 0; k < numberPattern->size(); k++) {
-        NumberPosition pattern = (*numberPattern)[k];
-        Coordinates adjusted = rotateNumber(pattern.coords.i, pattern.coords.j, m, n, orient);
+/* Gives the cause that marks the edges set by a rule in a given
+ * orientation anchored at a given place */
+int Solver::causeOf(CompiledPattern const & pattern, int i, int j) const {
+    int stride = grid_->getStride();
+    int area = (grid_->getHeight() + 1) * stride;
+    return (&pattern - &patterns_->getRulePattern(0)) * area + i * stride + j;
+}
 
-        if (pattern.num != grid_->getNumber(adjusted.i + i, adjusted.j + j)) {
-            return false;
+/* Adds the ends of every edge of each nogood that has one of the given
+ * assignments, whose edges could make the nogood force one of them */
+void Solver::addNogoodPoints(std::vector<EdgeAssignment> const & assignments, std::vector<Coordinates> & points) const {
+    if (!clauses_) {
+        return;
+    }
+
+    for (int k = 0; k < assignments.size(); k++) {
+        std::vector<int> const & occurrences = clauses_->getOccurrences(clauses_->literalOf(assignments[k]));
+        for (int x = 0; x < occurrences.size(); x++) {
+            int c = occurrences[x];
+            for (int const * l = clauses_->begin(c); l != clauses_->end(c); l++) {
+                EdgeAssignment a = clauses_->edgeOf(*l);
+                points.push_back(a.coords);
+                points.push_back(Coordinates { a.coords.i + !a.h, a.coords.j + a.h });
+            }
         }
     }
+}
 
-    std::vector<EdgePosition> const * hLinePattern = contradiction.getHLinePattern();
-    for (int k = 0; k < hLinePattern->size(); k++) {
-        EdgePosition pattern = (*hLinePattern)[k];
-        Coordinates adjusted = rotateHLine(pattern.coords.i, pattern.coords.j, m, n, orient);
+/* Applies rules until there are no longer any changes being made.
+ * A fresh grid first has every rule tried in each orientation in
+ * each valid position. After that, each edge that is set wakes only
+ * the rule orientations that check for that value at that edge, so
+ * the work done is in proportion to the number of edges set rather
+ * than to the area of the grid. The edges are kept on a queue by the
+ * grid, and applying a rule adds the edges it sets to the back.
+ * Once the rules run out, the nogoods are applied to the same edges,
+ * and once they run out too, the colors of the cells are related by
+ * them, and then the lines are kept to one block of the edges left;
+ * the rules start again on any edge that any of these set.
+ * A local guess only applies the rules anchored within its window.
+ * Propagation stops as soon as the grid is found to be invalid, or, in
+ * a guess, to be in contradiction. Those contradictions that only the
+ * patterns find are looked for among the edges set so far after each
+ * edge taken off the queue, which costs no more than looking for them
+ * once the rules run out, as each edge is only looked around once. */
+void Solver::applyRules(int const selectedRules[]) {
+    bool active[NUM_RULES] = { false };
+    for (int x = 0; x < selectLength_; x++) {
+        active[selectedRules[x]] = true;
+    }
 
-        switch (orient) {
-            case UPFLIP:
-            case UP:
-            case DOWNFLIP:
-            case DOWN:
-                if (pattern.edge != grid_->getHLine(adjusted.i + i, adjusted.j + j)) {
-                    return false;
+    if (grid_->getFullSweep(RULE_QUEUE)) {
+        grid_->setFullSweep(RULE_QUEUE, false);
+        grid_->discardChanges(RULE_QUEUE);
+        for (int i = 0; i < grid_->getHeight(); i++) {
+            for (int j = 0; j < grid_->getWidth(); j++) {
+                for (int x = 0; x < selectLength_; x++) {
+                    CompiledPattern const * end = patterns_->ruleEnd(selectedRules[x]);
+                    for (CompiledPattern const * p = patterns_->ruleBegin(selectedRules[x]); p != end; p++) {
+                        if (ruleApplies(i, j, *p)) {
+                            applyRule(i, j, *p);
+                        }
+                    }
                 }
-                break;
-            case LEFTFLIP:
-            case LEFT:
-            case RIGHTFLIP:
-            case RIGHT:
-                if (pattern.edge != grid_->getVLine(adjusted.i + i, adjusted.j + j)) {
-                    return false;
+            }
+        }
+    }
+
+    do {
+        while (grid_->hasChanges(RULE_QUEUE) && !stopsEarly()) {
+            EdgeAssignment change = grid_->popChange(RULE_QUEUE);
+            PatternTrigger const * end = patterns_->ruleTriggerEnd(change.h, change.edge);
+            for (PatternTrigger const * t = patterns_->ruleTriggerBegin(change.h, change.edge); t != end && grid_->getValid(); t++) {
+                CompiledPattern const & pattern = patterns_->getRulePattern(t->pattern);
+                int i = change.coords.i - t->di;
+                int j = change.coords.j - t->dj;
+                if (active[pattern.index] && i >= 0 && j >= 0 && inWindow(i, j) && ruleApplies(i, j, pattern)) {
+                    applyRule(i, j, pattern);
                 }
-                break;
+            }
+        }
+    } while (!stopsEarly() && (propagateNogoods() || propagateColors() || propagateConnectivity()));
+
+    grid_->setUpdated(false);
+}
+
+/* Tells whether applying rules should stop before they run out: once
+ * the grid is invalid or the budget of the guess is spent, and, for a
+ * solver making a guess, once a contradiction is found, as the guess
+ * is known to be wrong then and nothing else it leads to is used */
+bool Solver::stopsEarly() const {
+    return !grid_->getValid() || overBudget() || (nested_ && hitsContradiction());
+}
+
+/* Applies a rule in a given orientation to a given region of the
+ * grid, overwriting all old values with any applicable values from
+ * the after_ lattice for that rule. The edges it sets are marked as
+ * following from the rule in place, for explaining contradictions. */
+void Solver::applyRule(int i, int j, CompiledPattern const & pattern) {
+    PatternElement const * elements = patterns_->getElements();
+    grid_->setCause(causeOf(pattern, i, j));
+    if (budget_) {
+        budget_->spendRule();
+    }
+
+    for (int k = pattern.diffStart; k < pattern.diffEnd; k++) {
+        PatternElement const & diff = elements[k];
+        bool hline = (diff.plane == HLINE_CELLS);
+
+        if (getLine(i + diff.di, j + diff.dj, hline) == EMPTY) {
+            setLine(i + diff.di, j + diff.dj, hline, (Edge)diff.value);
+            grid_->setUpdated(true);
         }
     }
+    grid_->setCause(NO_CAUSE);
+}
 
-    std::vector<EdgePosition> const * vLinePattern = contradiction.getVLinePattern();
-    for (int k = 0; k < vLinePattern->size(); k++) {
-        EdgePosition pattern = (*vLinePattern)[k];
-        Coordinates adjusted = rotateVLine(pattern.coords.i, pattern.coords.j, m, n, orient);
+/* Checks if a rule in a given orientation applies to a given
+ * region of the grid by checking all non-empty values in the
+ * before_ lattice and verifying they correspond to the values
+ * in the grid. The orientation has already been resolved into
+ * offsets from the number at (i, j), so this is a straight loop
+ * of loads and compares. */
+bool Solver::ruleApplies(int i, int j, CompiledPattern const & pattern) const {
+    if (i > grid_->getHeight() - pattern.height
+            || j > grid_->getWidth() - pattern.width) {
+        return false;
+    }
 
-        switch (orient) {
-            case UPFLIP:
-            case UP:
-            case DOWNFLIP:
-            case DOWN:
-                if (pattern.edge != grid_->getVLine(adjusted.i + i, adjusted.j + j)) {
-                    return false;
-                }
-                break;
-            case LEFTFLIP:
-            case LEFT:
-            case RIGHTFLIP:
-            case RIGHT:
-                if (pattern.edge != grid_->getHLine(adjusted.i + i, adjusted.j + j)) {
-                    return false;
-                }
-                break;
+    unsigned char const * anchor = grid_->getCells() + i * grid_->getStride() + j;
+    PatternElement const * elements = patterns_->getElements();
+    for (int k = pattern.checkStart; k < pattern.checkEnd; k++) {
+        if (anchor[elements[k].offset] != elements[k].value) {
+            return false;
         }
     }
 
     return true;
 }
+
+/* Checks if a contradiction in a given orientation applies to
+ * a given region of the grid by checking all non-empty values
+ * in the before_ lattice and verifying they correspond to the
+ * values in the grid. */
+bool Solver::contradictionApplies(int i, int j, CompiledPattern const & pattern) const {
+    return ruleApplies(i, j, pattern);
+}
@@ -1,45 +1,186 @@
 #ifndef SOLVER_H
 #define SOLVER_H
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "cellcoloring.h"
+#include "clausedatabase.h"
+#include "clausewatches.h"
 #include "contradiction.h"
 #include "epq.h"
+#include "gridarena.h"
+#include "guessarena.h"
+#include "heuristic.h"
+#include "loopconnectivity.h"
+#include "patterntable.h"
+#include "probebudget.h"
+#include "probecache.h"
 #include "rule.h"
+#include "solutioncounter.h"
+#include "threadpool.h"
+#include "transpositiontable.h"
 #include "../shared/constants.h"
 #include "../shared/enums.h"
 #include "../shared/grid.h"
+#include "../shared/structs.h"
+
+class SolverEngine;
+class SolveSession;
 
 class Solver {
     public:
         Solver(Grid & grid, Rule rules[NUM_RULES], Contradiction contradictions[NUM_CONTRADICTIONS], int selectedRules[], int selectLength, int depth);
-        Solver(Grid & grid, Rule rules[NUM_RULES], Contradiction contradictions[NUM_CONTRADICTIONS], int selectedRules[], int selectLength, int depth, EPQ oldEPQ);
+        Solver(Grid & grid, Rule rules[NUM_RULES], Contradiction contradictions[NUM_CONTRADICTIONS], int selectedRules[], int selectLength, int depth, SolverOptions const & options);
+        Solver(Grid & grid, SolverEngine const & engine, SolveSession & session);
         bool testContradictions() const;
         bool hasMultipleSolutions() const { return multipleSolutions_; };
+        SolveStatus getStatus() const;
         void resetSolver();
+        TableStats getTableStats() const;
+        long getGuesses() const { return *guesses_; };
+        long getInconclusive() const { return *inconclusive_; };
+        int getDepthUsed() const { return depthUsed_; };
         int ruleCounts_;
 
     private:
+        friend class SolveSession;
+
+        /* What probing an edge did to a copy of the grid, kept so that
+         * it can be replayed onto the grid itself, along with the task
+         * doing the probing */
+        struct ProbeResult {
+            std::vector<EdgeAssignment> assignments;
+            bool updated;
+            bool multipleSolutions;
+            int ruleCounts;
+            std::vector<Nogood> learned;
+            Grid * grid;
+            ForkedTask task;
+            std::unique_ptr<CancelToken> cancel;
+        };
+
+        /* An edge at the top of the EPQ in the sweep of solveDepth,
+         * with the state of the EPQ when it got there */
+        struct PlannedProbe {
+            PrioEdge pe;
+            bool probed;
+            EPQ epq;
+        };
+
+        /* One value guessed for an edge. When there are threads to
+         * spare, the NLINE guess is started on a scratch grid before
+         * the LINE guess is made on the grid itself, so that the two
+         * are worked on at once. */
+        struct Branch {
+            Grid * grid;
+            Solver * solver;    /* held by the scratch of the guess */
+            std::unique_ptr<CancelToken> cancel;
+            ForkedTask task;
+            bool speculative;
+        };
+
+        Solver(Grid & grid, Solver const & parent);
+        void inherit(Grid & grid, Solver const & parent);
+        Solver & spawn(std::unique_ptr<Solver> & slot, Grid & grid) const;
+        void startGuess(int depth);
+        void startSolving(int const selectedPlusBasic[], int selectLength);
         void solve();
+        bool usesSat() const;
+        void solveBySat();
+        void solveGuess();
+        static uint64_t searchHashOf(int depth);
+        void replay(GuessOutcome const & outcome);
+        void keepSolving();
+        void guessDepths(int from);
+        void deepen(int depth);
+        bool cancelled() const { return (cancel_ && cancel_->isCancelled()) || overBudget(); };
+        bool overBudget() const { return budget_ && budget_->isSpent(); };
+        void startBudget();
+        bool endBudget();
         void solveDepth(int depth);
+        bool guessLocally();
+        bool distancesToEnds(std::vector<int> & distances) const;
+        bool inWindow(int i, int j) const;
+        bool fitsWindow(std::vector<Coordinates> const & points) const;
+        void probeEdge(PrioEdge const & pe, int depth);
+        void solveDepthParallel(int depth);
+        void planProbes(int maxSteps, std::vector<PlannedProbe> & plan) const;
+        void startProbes(std::vector<PlannedProbe> const & plan, int depth, std::vector<ProbeResult> & results);
+        void finishProbe(ProbeResult & result);
+        void discardProbes(std::vector<ProbeResult> & results, int from);
+        void probe(PlannedProbe const & planned, int depth, ProbeResult & result) const;
         void makeHLineGuess(int i, int j, int depth);
         void makeVLineGuess(int i, int j, int depth);
+        void makeGuess(int i, int j, bool hline, int depth);
+        void makeGuess(int i, int j, bool hline, int depth, GuessScratch & scratch);
+        void startBranch(GuessScratch & scratch, Branch & branch, int i, int j, bool hline, Edge edge, int depth);
+        void finishBranch(GuessScratch & scratch, Branch & branch, int i, int j, bool hline, Edge edge, int depth);
+        void cancelBranch(Branch & branch);
+        void endBranch(Branch & branch);
+        Edge getLine(int i, int j, bool hline) const;
+        void setLine(int i, int j, bool hline, Edge edge);
 
         void updateEPQ();
 
-        void intersectGrids(Grid const & lineGuess, Grid const & nLineGuess);
+        void intersectGrids(std::vector<EdgeAssignment> const & common);
+
+        bool propagateNogoods();
+        bool propagateColors();
+        bool propagateConnectivity();
+        bool seesWholeGrid() const;
+        bool breaksNogood() const;
+        bool publishNogoods();
+        void absorbNogoods(Solver & child);
+        void learnFrom(Solver const & branch);
+        bool explainContradiction(Nogood & conflict) const;
+        bool resolveConflict(Nogood & nogood) const;
+        void addCauseLiterals(int cause, int edge, std::vector<int> & literals) const;
+        int causeOf(CompiledPattern const & pattern, int i, int j) const;
+        void addNogoodPoints(std::vector<EdgeAssignment> const & assignments, std::vector<Coordinates> & points) const;
 
-        void applyRules(int selectedRules[]);
-        void applyRule(int i, int j, Rule & rule, Orientation orient);
-        bool ruleApplies(int i, int j, Rule const & rule, Orientation orient) const;
-        bool contradictionApplies(int i, int j, Contradiction const & contradiction, Orientation orient) const;
+        void applyRules(int const selectedRules[]);
+        bool stopsEarly() const;
+        bool hitsContradiction() const;
+        void applyRule(int i, int j, CompiledPattern const & pattern);
+        bool ruleApplies(int i, int j, CompiledPattern const & pattern) const;
+        bool contradictionApplies(int i, int j, CompiledPattern const & pattern) const;
 
         Grid * grid_;
         int depth_;
-        Rule * rules_;
-        int * selectedRules_;
+        Rule const * rules_;
+        int const * selectedRules_;
         int selectLength_;
-        Contradiction * contradictions_;
+        Contradiction const * contradictions_;
+        std::shared_ptr<PatternTable const> patterns_;
         EPQ epq_;
-        int epqSize_;
+        std::shared_ptr<Heuristic const> heuristic_;
         bool multipleSolutions_;
+        SolverOptions options_;
+        std::shared_ptr<ThreadPool> pool_;
+        std::shared_ptr<GridArena> arena_;
+        CancelToken const * cancel_;
+        std::shared_ptr<TranspositionTable> table_;
+        bool fromTable_;        /* whether the grid was solved by replaying the table */
+        std::unique_ptr<ProbeCache> probes_;
+        std::unique_ptr<ProbeCache> spareProbes_;  /* the cache of an earlier guess, to be reset rather than made again */
+        ProbeCache const * parentProbes_;
+        std::vector<Coordinates> footprint_;   /* points touched by the last guess of depth 0 to learn nothing */
+        std::shared_ptr<ClauseDatabase> clauses_;
+        std::shared_ptr<ClauseWatches> watches_;
+        std::shared_ptr<CellColoring> coloring_;
+        std::shared_ptr<LoopConnectivity> connectivity_;
+        std::vector<Nogood> learned_;   /* nogoods learned by this solver and those it spawned, not yet in the database */
+        bool nested_;           /* whether the grid holds guesses made by other solvers */
+        std::shared_ptr<std::atomic<long> > guesses_;  /* guesses made by every solver of the tree */
+        Coordinates windowCenter_;  /* where the edge guessed by a local guess is */
+        int windowRadius_;      /* how far from it the rules of the guess are applied, or -1 for everywhere */
+        std::shared_ptr<ProbeBudget> budget_;   /* what is left to spend on the guess of the first solver being made */
+        std::shared_ptr<std::atomic<long> > inconclusive_;  /* guesses of the first solver that ran out of budget */
+        int depthUsed_;         /* one more than the depth of the deepest sweep of guesses it made, or 0 for none */
+        GuessArena * guessArena_;   /* scratch for the guesses of every solver of the tree, held by the session or the first solver, since the solvers it holds cannot hold it in turn */
+        std::unique_ptr<GuessArena> ownGuessArena_;
+        GuessOutcome outcome_;      /* what solveGuess found, kept so that a solver started afresh reuses it */
+        GuessOutcome rulesOutcome_; /* what solveGuess found the rules did, likewise */
 };
 
 #endif
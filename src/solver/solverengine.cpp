@@ -0,0 +1,45 @@
+#include "solverengine.h"
+#include <memory>
+#include <vector>
+#include "contradiction.h"
+#include "contradictions.h"
+#include "heuristic.h"
+#include "patterntable.h"
+#include "rule.h"
+#include "rules.h"
+#include "../shared/constants.h"
+#include "../shared/grid.h"
+#include "../shared/structs.h"
+
+/* Builds the rules and contradictions and compiles them for grids the
+ * size of the one given. The basic rules are always applied, after
+ * the ones selected. */
+SolverEngine::SolverEngine(Grid const & grid, int const selectedRules[], int selectLength, int depth, SolverOptions const & options) {
+    m_ = grid.getHeight();
+    n_ = grid.getWidth();
+    depth_ = depth;
+    options_ = options;
+
+    initRules(rules_);
+    initContradictions(contradictions_);
+
+    selectedRules_.assign(selectedRules, selectedRules + selectLength);
+    for (int r = NUM_RULES - NUM_CONST_RULES; r < NUM_RULES; r++) {
+        selectedRules_.push_back(r);
+    }
+    selectLength_ = selectLength;
+
+    std::shared_ptr<PatternTable> patterns(new PatternTable());
+    patterns->compile(rules_, contradictions_, grid.getStride(), grid.getHLineStart(), grid.getVLineStart());
+    patterns->indexTriggers();
+    patterns_ = patterns;
+
+    heuristic_ = makeHeuristic(options_.ordering);
+}
+
+/* Checks whether a grid is of the size the patterns were compiled
+ * for, which puts its edges where the patterns look for them */
+bool SolverEngine::fits(Grid const & grid) const {
+    return grid.getHeight() == m_ && grid.getWidth() == n_
+        && grid.getStride() == patterns_->getStride();
+}
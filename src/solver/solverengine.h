@@ -0,0 +1,43 @@
+#ifndef SOLVERENGINE_H
+#define SOLVERENGINE_H
+#include <memory>
+#include <vector>
+#include "contradiction.h"
+#include "heuristic.h"
+#include "patterntable.h"
+#include "rule.h"
+#include "../shared/constants.h"
+#include "../shared/grid.h"
+#include "../shared/structs.h"
+
+/* What every solve of grids of one size with the same rules, depth
+ * and options has in common: the rules and contradictions, built and
+ * compiled into their orientations once, the rules selected and the
+ * heuristic ranking the edges to guess. Nothing changes it once it is
+ * made, so any number of sessions, on any threads, can solve with one
+ * engine at once. */
+class SolverEngine {
+    public:
+        SolverEngine(Grid const & grid, int const selectedRules[], int selectLength, int depth, SolverOptions const & options);
+        bool fits(Grid const & grid) const;
+        int getHeight() const { return m_; };
+        int getWidth() const { return n_; };
+        int getDepth() const { return depth_; };
+        SolverOptions const & getOptions() const { return options_; };
+
+    private:
+        friend class Solver;
+
+        int m_;
+        int n_;
+        int depth_;
+        SolverOptions options_;
+        Rule rules_[NUM_RULES];
+        Contradiction contradictions_[NUM_CONTRADICTIONS];
+        std::vector<int> selectedRules_;    /* the rules selected, followed by the basic rules */
+        int selectLength_;
+        std::shared_ptr<PatternTable const> patterns_;
+        std::shared_ptr<Heuristic const> heuristic_;
+};
+
+#endif
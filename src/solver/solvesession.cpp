@@ -0,0 +1,93 @@
+#include "solvesession.h"
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include <utility>
+#include "cellcoloring.h"
+#include "clausedatabase.h"
+#include "clausewatches.h"
+#include "epq.h"
+#include "gridarena.h"
+#include "guessarena.h"
+#include "loopconnectivity.h"
+#include "probecache.h"
+#include "solver.h"
+#include "solverengine.h"
+#include "threadpool.h"
+#include "transpositiontable.h"
+#include "../shared/enums.h"
+#include "../shared/grid.h"
+
+/* Makes what every solve of the session shares, as far as it can be
+ * made before the first grid is seen */
+SolveSession::SolveSession(SolverEngine const & engine) {
+    engine_ = &engine;
+    SolverOptions const & options = engine.getOptions();
+
+    epq_.initEPQ(engine.getHeight(), engine.getWidth());
+
+    if (options.threads > 1) {
+        pool_ = std::make_shared<ThreadPool>(options.threads);
+        arena_ = std::make_shared<GridArena>(options.threads);
+    }
+    if (options.tableMegabytes > 0) {
+        table_ = std::make_shared<TranspositionTable>((size_t)options.tableMegabytes << 20);
+    }
+    if (options.coloring) {
+        coloring_ = std::make_shared<CellColoring>();
+    }
+    if (options.connectivity) {
+        connectivity_ = std::make_shared<LoopConnectivity>();
+    }
+    guessArena_ = std::make_shared<GuessArena>(options.threads);
+    guesses_ = std::make_shared<std::atomic<long> >(0);
+    inconclusive_ = std::make_shared<std::atomic<long> >(0);
+}
+
+/* Solves a grid of the size of the engine as far as the engine can,
+ * starting from the edges already on it. Nothing learned from one
+ * grid is kept for the next, since the same edges say something else
+ * around other numbers. */
+SolveResult SolveSession::solve(Grid & grid) {
+    assert(engine_->fits(grid));
+
+    if (table_) {
+        table_->clear();
+    }
+    if (clauses_) {
+        clauses_->clear();
+        watches_->reset();
+    } else if (engine_->getOptions().learning) {
+        clauses_ = std::make_shared<ClauseDatabase>(grid);
+        watches_ = std::make_shared<ClauseWatches>(*clauses_);
+    }
+    *guesses_ = 0;
+    *inconclusive_ = 0;
+
+    Solver solver(grid, *engine_, *this);
+
+    SolveResult result;
+    result.status = solver.getStatus();
+    result.depth = solver.getDepthUsed();
+    result.guesses = solver.getGuesses();
+    result.inconclusive = solver.getInconclusive();
+    result.ruleCounts = solver.ruleCounts_;
+
+    /* keep what the solver grew for the next grid */
+    spareEpq_ = std::move(solver.epq_);
+    if (solver.probes_) {
+        probes_ = std::move(solver.probes_);
+    } else if (solver.spareProbes_) {
+        probes_ = std::move(solver.spareProbes_);
+    }
+    return result;
+}
+
+/* Gives the counts of the transposition table for the last grid
+ * solved, or zeroes if there is none */
+TableStats SolveSession::getTableStats() const {
+    if (!table_) {
+        return TableStats { 0, 0, 0, 0 };
+    }
+    return table_->getStats();
+}
@@ -0,0 +1,64 @@
+#ifndef SOLVESESSION_H
+#define SOLVESESSION_H
+#include <atomic>
+#include <memory>
+#include "cellcoloring.h"
+#include "clausedatabase.h"
+#include "clausewatches.h"
+#include "epq.h"
+#include "gridarena.h"
+#include "guessarena.h"
+#include "loopconnectivity.h"
+#include "probecache.h"
+#include "solverengine.h"
+#include "threadpool.h"
+#include "transpositiontable.h"
+#include "../shared/enums.h"
+#include "../shared/grid.h"
+
+/* How solving a grid went: whether it ended solved, stuck, in a
+ * contradiction or with several solutions, the deepest guesses it
+ * made, and what it took to get there */
+struct SolveResult {
+    SolveStatus status;
+    int depth;
+    long guesses;
+    long inconclusive;  /* guesses that ran out of budget */
+    int ruleCounts;
+};
+
+/* Solves grid after grid with one engine, on one thread at a time.
+ * What a solver would otherwise allocate each time it is made is kept
+ * by the session and emptied rather than freed between grids: the
+ * queue of edges to guess, the threads and their scratch grids, the
+ * transposition table, the nogoods and their watches, the coloring
+ * of the cells, the blocks of the edges, the solvers and lists of the
+ * guesses, and the heap of the queue and the probe cache that the
+ * last grid left. Once it has solved a few grids, the session has
+ * grown each of them as far as they need to go. */
+class SolveSession {
+    public:
+        SolveSession(SolverEngine const & engine);
+        SolveResult solve(Grid & grid);
+        TableStats getTableStats() const;
+
+    private:
+        friend class Solver;
+
+        SolverEngine const * engine_;
+        EPQ epq_;           /* every edge queued at no priority, shared by each solve until it changes it */
+        EPQ spareEpq_;      /* the queue the last solve left, whose heap the next copies into */
+        std::unique_ptr<ProbeCache> probes_;    /* the probe cache the last solve left, to be reset for the next */
+        std::shared_ptr<GuessArena> guessArena_;
+        std::shared_ptr<ThreadPool> pool_;
+        std::shared_ptr<GridArena> arena_;
+        std::shared_ptr<TranspositionTable> table_;
+        std::shared_ptr<ClauseDatabase> clauses_;
+        std::shared_ptr<ClauseWatches> watches_;
+        std::shared_ptr<CellColoring> coloring_;
+        std::shared_ptr<LoopConnectivity> connectivity_;
+        std::shared_ptr<std::atomic<long> > guesses_;
+        std::shared_ptr<std::atomic<long> > inconclusive_;
+};
+
+#endif
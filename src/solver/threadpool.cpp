@@ -0,0 +1,162 @@
+#include "threadpool.h"
+#include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* The pool and worker that the current thread belongs to */
+static thread_local ThreadPool const * currentPool = NULL;
+static thread_local int currentWorker = 0;
+
+/* Starts threads-1 workers; the thread creating the pool is worker 0 */
+ThreadPool::ThreadPool(int threads) {
+    assert(threads > 0);
+
+    queued_ = 0;
+    for (int w = 0; w < threads; w++) {
+        deques_.push_back(std::unique_ptr<Deque>(new Deque()));
+    }
+    for (int w = 1; w < threads; w++) {
+        threads_.push_back(std::thread(&ThreadPool::workerLoop, this, w));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        stopping_ = true;
+    }
+    changed_.notify_all();
+
+    for (int w = 0; w < threads_.size(); w++) {
+        threads_[w].join();
+    }
+}
+
+/* Gives the worker that the calling thread is; threads outside of
+ * the pool count as worker 0 */
+int ThreadPool::getWorker() const {
+    return currentPool == this ? currentWorker : 0;
+}
+
+/* Puts work on the deque of the calling worker for it or a thief */
+void ThreadPool::fork(ForkedTask & task, std::function<void()> work) {
+    task.state_ = std::make_shared<ForkedTask::State>();
+    task.state_->work = std::move(work);
+    task.state_->claimed = false;
+    task.state_->done = false;
+
+    Deque & deque = *deques_[getWorker()];
+    {
+        std::lock_guard<std::mutex> lock(deque.mutex);
+        deque.tasks.push_back(task.state_);
+        queued_++;
+    }
+
+    std::lock_guard<std::mutex> lock(sleepMutex_);
+    changed_.notify_one();
+}
+
+/* Returns once a forked task is done, running it on the calling
+ * thread if no worker has taken it yet */
+void ThreadPool::join(ForkedTask & task) {
+    TaskState state = task.state_;
+    runTask(state);
+    helpUntilDone(state);
+    task.state_.reset();
+}
+
+/* Makes sure that a forked task will not be started, waiting for it
+ * if a worker already has */
+void ThreadPool::discard(ForkedTask & task) {
+    TaskState state = task.state_;
+    if (!state->claimed.exchange(true)) {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        state->work = nullptr;
+        state->done = true;
+    }
+    helpUntilDone(state);
+    task.state_.reset();
+}
+
+/* Runs tasks until the pool is destroyed, sleeping when there are none */
+void ThreadPool::workerLoop(int worker) {
+    currentPool = this;
+    currentWorker = worker;
+
+    while (true) {
+        TaskState task;
+        if (findTask(worker, task)) {
+            runTask(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        changed_.wait(lock, [this] { return stopping_ || queued_ > 0; });
+        if (stopping_) {
+            return;
+        }
+    }
+}
+
+/* Takes the newest task of a worker's own deque, or else the oldest
+ * task of the first other deque that has one */
+bool ThreadPool::findTask(int worker, TaskState & task) {
+    for (int k = 0; k < deques_.size(); k++) {
+        Deque & deque = *deques_[(worker + k) % deques_.size()];
+        std::lock_guard<std::mutex> lock(deque.mutex);
+        if (deque.tasks.empty()) {
+            continue;
+        }
+
+        if (k == 0) {
+            task = deque.tasks.back();
+            deque.tasks.pop_back();
+        } else {
+            task = deque.tasks.front();
+            deque.tasks.pop_front();
+        }
+        queued_--;
+        return true;
+    }
+
+    return false;
+}
+
+/* Runs a task unless another thread has claimed it first */
+void ThreadPool::runTask(TaskState const & task) {
+    if (task->claimed.exchange(true)) {
+        return;
+    }
+
+    task->work();
+
+    std::lock_guard<std::mutex> lock(sleepMutex_);
+    task->work = nullptr;
+    task->done = true;
+    changed_.notify_all();
+}
+
+/* Works on other tasks until a task claimed elsewhere is done */
+void ThreadPool::helpUntilDone(TaskState const & task) {
+    int worker = getWorker();
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(sleepMutex_);
+            changed_.wait(lock, [this, &task] { return task->done || queued_ > 0; });
+            if (task->done) {
+                return;
+            }
+        }
+
+        TaskState other;
+        if (findTask(worker, other)) {
+            runTask(other);
+        }
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Work handed to a pool by a thread that will later need it done.
+ * Whichever comes first runs it: a worker that steals it, or the
+ * thread joining it. */
+class ForkedTask {
+    public:
+        ForkedTask() { };
+
+    private:
+        friend class ThreadPool;
+        struct State {
+            std::function<void()> work;
+            std::atomic<bool> claimed;  /* some thread has started or skipped it */
+            bool done;                  /* guarded by the sleep mutex of the pool */
+        };
+
+        std::shared_ptr<State> state_;
+};
+
+/* A fixed set of worker threads that steal work from each other.
+ * Each worker keeps the tasks it forks on a deque of its own, and
+ * takes work from the back of its own deque or, once that is empty,
+ * from the front of another's, so that thieves take the oldest and
+ * usually largest tasks. A thread joining a task that has been
+ * stolen works on other tasks until it is done, so tasks can be
+ * nested to any depth without running out of threads. The thread
+ * that created the pool counts as worker 0. */
+class ThreadPool {
+    public:
+        ThreadPool(int threads);
+        ~ThreadPool();
+        int getThreads() const { return deques_.size(); };
+        int getWorker() const;
+        void fork(ForkedTask & task, std::function<void()> work);
+        void join(ForkedTask & task);
+        void discard(ForkedTask & task);
+
+    private:
+        typedef std::shared_ptr<ForkedTask::State> TaskState;
+
+        struct Deque {
+            std::mutex mutex;
+            std::deque<TaskState> tasks;
+        };
+
+        void workerLoop(int worker);
+        bool findTask(int worker, TaskState & task);
+        void runTask(TaskState const & task);
+        void helpUntilDone(TaskState const & task);
+
+        std::vector<std::unique_ptr<Deque> > deques_;
+        std::vector<std::thread> threads_;
+        std::atomic<int> queued_;   /* tasks sitting on any deque */
+        std::mutex sleepMutex_;
+        std::condition_variable changed_;   /* a task was forked or finished */
+        bool stopping_ = false;
+};
+
+/* Lets a solver that was started on speculation be told to give up,
+ * along with every solver it has started in turn */
+class CancelToken {
+    public:
+        CancelToken(CancelToken const * parent) : cancelled_(false), parent_(parent) { };
+        void cancel() { cancelled_ = true; };
+        bool isCancelled() const { return cancelled_ || (parent_ && parent_->isCancelled()); };
+
+    private:
+        std::atomic<bool> cancelled_;
+        CancelToken const * parent_;
+};
+
+#endif
@@ -0,0 +1,180 @@
+#include "transpositiontable.h"
+#include <algorithm>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "clausedatabase.h"
+#include "../shared/structs.h"
+
+#define INITIAL_SLOTS 1024
+#define WAYS 4      /* slots per bucket, any of which may hold a state */
+
+/* Limits the slots of the table to a quarter of the budget, leaving
+ * the rest for the deductions they hold */
+TranspositionTable::TranspositionTable(size_t maxBytes) {
+    maxSlots_ = WAYS;
+    while (2 * maxSlots_ * sizeof(Entry) <= maxBytes / 4) {
+        maxSlots_ *= 2;
+    }
+
+    entries_.resize(std::min(maxSlots_, (size_t)INITIAL_SLOTS));
+    for (size_t k = 0; k < entries_.size(); k++) {
+        entries_[k].used = false;
+    }
+
+    used_ = 0;
+    maxBytes_ = maxBytes;
+    bytes_ = entries_.size() * sizeof(Entry);
+    hand_ = 0;
+    stats_ = TableStats { 0, 0, 0, 0 };
+}
+
+/* Copies out the outcome stored for a state, if there is one */
+bool TranspositionTable::lookup(uint64_t gridHash, uint64_t searchHash, GuessOutcome & outcome) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.lookups++;
+
+    size_t bucket = bucketOf(gridHash, searchHash);
+    for (size_t k = bucket; k < bucket + WAYS; k++) {
+        Entry const & entry = entries_[k];
+        if (entry.used && entry.gridHash == gridHash && entry.searchHash == searchHash) {
+            outcome = entry.outcome;
+            stats_.hits++;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Stores the outcome for a state in a free slot of its bucket, or in
+ * place of the state already there or one picked by its hash, then
+ * evicts other entries until the table is back within budget */
+void TranspositionTable::store(uint64_t gridHash, uint64_t searchHash, GuessOutcome const & outcome) {
+    size_t bytes = bytesOf(outcome);
+    if (bytes > maxBytes_ / 4) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.stores++;
+    if (2 * used_ >= entries_.size() && entries_.size() < maxSlots_) {
+        grow();
+    }
+
+    size_t bucket = bucketOf(gridHash, searchHash);
+    size_t slot = bucket + (gridHash >> 62) % WAYS;
+    for (size_t k = bucket + WAYS; k-- > bucket; ) {
+        if (!entries_[k].used || (entries_[k].gridHash == gridHash && entries_[k].searchHash == searchHash)) {
+            slot = k;
+        }
+    }
+
+    /* the outcome taking the place of another is copied into the
+     * memory it had, rather than that being given back first */
+    Entry & entry = entries_[slot];
+    if (entry.used) {
+        if (entry.gridHash != gridHash || entry.searchHash != searchHash) {
+            stats_.evictions++;
+        }
+        bytes_ -= bytesOf(entry.outcome);
+        used_--;
+    }
+    entry.gridHash = gridHash;
+    entry.searchHash = searchHash;
+    entry.used = true;
+    entry.outcome = outcome;
+    bytes_ += bytes;
+    used_++;
+
+    while (bytes_ > maxBytes_) {
+        Entry & victim = entries_[hand_];
+        hand_ = (hand_ + 1) % entries_.size();
+        if (victim.used && &victim != &entry) {
+            evict(victim);
+            stats_.evictions++;
+        }
+    }
+}
+
+/* Empties the table for solving another grid, keeping the slots it
+ * has grown to and the memory of the outcomes that were in them, and
+ * starts its counts over */
+void TranspositionTable::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t k = 0; k < entries_.size(); k++) {
+        Entry & entry = entries_[k];
+        if (entry.used) {
+            bytes_ -= bytesOf(entry.outcome);
+            entry.outcome.deductions.clear();
+            entry.outcome.causes.clear();
+            entry.outcome.nogoods.clear();
+            entry.used = false;
+        }
+    }
+    used_ = 0;
+    hand_ = 0;
+    stats_ = TableStats { 0, 0, 0, 0 };
+}
+
+TableStats TranspositionTable::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+/* Gives the memory that the deductions and nogoods of an outcome take */
+size_t TranspositionTable::bytesOf(GuessOutcome const & outcome) {
+    size_t bytes = outcome.deductions.size() * (sizeof(EdgeAssignment) + sizeof(int));
+    for (int k = 0; k < outcome.nogoods.size(); k++) {
+        bytes += sizeof(Nogood) + outcome.nogoods[k].size() * sizeof(int);
+    }
+    return bytes;
+}
+
+/* Gives the first slot of the bucket that a state belongs in */
+size_t TranspositionTable::bucketOf(uint64_t gridHash, uint64_t searchHash) const {
+    uint64_t h = gridHash ^ (searchHash * 0x9e3779b97f4a7c15ULL);
+    return ((h ^ (h >> 32)) & (entries_.size() / WAYS - 1)) * WAYS;
+}
+
+/* Empties a slot, giving back the memory of its deductions and nogoods */
+void TranspositionTable::evict(Entry & entry) {
+    bytes_ -= bytesOf(entry.outcome);
+    std::vector<EdgeAssignment>().swap(entry.outcome.deductions);
+    std::vector<int>().swap(entry.outcome.causes);
+    std::vector<Nogood>().swap(entry.outcome.nogoods);
+    entry.used = false;
+    used_--;
+}
+
+/* Doubles the number of buckets, moving every entry to its new
+ * bucket; each bucket splits into two, so none of them overflows */
+void TranspositionTable::grow() {
+    std::vector<Entry> old(entries_.size() * 2);
+    old.swap(entries_);
+    for (size_t k = 0; k < entries_.size(); k++) {
+        entries_[k].used = false;
+    }
+    bytes_ += old.size() * sizeof(Entry);
+    hand_ = 0;
+
+    for (size_t k = 0; k < old.size(); k++) {
+        if (old[k].used) {
+            size_t slot = bucketOf(old[k].gridHash, old[k].searchHash);
+            while (entries_[slot].used) {
+                slot++;
+            }
+            Entry & entry = entries_[slot];
+            entry.gridHash = old[k].gridHash;
+            entry.searchHash = old[k].searchHash;
+            entry.used = true;
+            entry.outcome.deductions.swap(old[k].outcome.deductions);
+            entry.outcome.causes.swap(old[k].outcome.causes);
+            entry.outcome.nogoods.swap(old[k].outcome.nogoods);
+            entry.outcome.contradiction = old[k].outcome.contradiction;
+            entry.outcome.multipleSolutions = old[k].outcome.multipleSolutions;
+            entry.outcome.ruleCounts = old[k].outcome.ruleCounts;
+        }
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef TRANSPOSITIONTABLE_H
+#define TRANSPOSITIONTABLE_H
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "clausedatabase.h"
+#include "../shared/structs.h"
+
+/* What a solver spawned for a guess made of the grid it was given:
+ * the edges it set, in order, with what each followed from, how it
+ * ended and the nogoods it learned on the way */
+struct GuessOutcome {
+    std::vector<EdgeAssignment> deductions;
+    std::vector<int> causes;
+    std::vector<Nogood> nogoods;
+    bool contradiction;
+    bool multipleSolutions;
+    int ruleCounts;
+};
+
+/* Counts of what a transposition table has been asked to do */
+struct TableStats {
+    long lookups;
+    long hits;
+    long stores;
+    long evictions;
+};
+
+/* Remembers the outcome of guesses by the state they were made from,
+ * so that reaching the same grid again by another path, or probing
+ * the same edge again before anything near it has changed, costs a
+ * lookup rather than a search. A state is identified by the hash of
+ * the grid along with a hash of everything else the outcome depends
+ * on, such as the depth of the search and the order it makes guesses
+ * in. The table starts out small and doubles as it fills, but holds
+ * no more than a given number of bytes, evicting the entries in its
+ * way in turn once it is full. */
+class TranspositionTable {
+    public:
+        TranspositionTable(size_t maxBytes);
+        bool lookup(uint64_t gridHash, uint64_t searchHash, GuessOutcome & outcome);
+        void store(uint64_t gridHash, uint64_t searchHash, GuessOutcome const & outcome);
+        void clear();
+        TableStats getStats() const;
+
+    private:
+        struct Entry {
+            uint64_t gridHash;
+            uint64_t searchHash;
+            bool used;
+            GuessOutcome outcome;
+        };
+
+        static size_t bytesOf(GuessOutcome const & outcome);
+        size_t bucketOf(uint64_t gridHash, uint64_t searchHash) const;
+        void evict(Entry & entry);
+        void grow();
+
+        std::vector<Entry> entries_;
+        size_t used_;
+        size_t maxSlots_;
+        size_t maxBytes_;
+        size_t bytes_;      /* taken by the slots and every deduction held */
+        size_t hand_;       /* next slot to evict when over budget */
+        TableStats stats_;
+        mutable std::mutex mutex_;
+};
+
+#endif